@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstddef>
+
+#include "stats.hpp"
+
+namespace yhok::hokacc::bench {
+
+// このスレッドで置き換えたoperator new (src/alloc_hook.cpp) が呼ばれた回数
+inline std::size_t allocation_count() {
+    return AllocationCounter::count;
+}
+
+// スコープ内で行われたヒープ確保の回数を数える
+struct AllocationScope {
+    std::size_t start = allocation_count();
+
+    std::size_t count() const {
+        return allocation_count() - start;
+    }
+};
+
+}
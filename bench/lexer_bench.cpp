@@ -0,0 +1,180 @@
+#include <cstdint>
+#include <limits>
+#include <random>
+#include <string>
+#include <string_view>
+
+#include <benchmark/benchmark.h>
+
+#include "token.hpp"
+
+using namespace yhok::hokacc;
+
+
+namespace {
+
+// テーブル駆動にする前の、if文を連ねた実装。比較用に残しておく
+TokenBuffer legacy_tokenize(std::string_view str) {
+    if (str.size() >= std::numeric_limits<std::uint32_t>::max()) {
+        spdlog::error("Input too large to tokenize: {} bytes", str.size());
+        std::exit(1);
+    }
+
+    TokenBuffer tokens;
+    // 大抵のソースはトークン数が文字数の半分に収まる
+    tokens.reserve(str.size() / 2 + 16);
+
+    std::size_t loc = 0;
+    auto c = str.begin();
+    while (c != str.end()) {
+        loc = c - str.begin();
+        if (std::isspace(*c)) {
+            ++c;
+            continue;
+        }
+        if (*c == '!') {
+            if ((c + 1) != str.end() && *(c + 1) == '=') {
+                tokens.push(TokenKind::NotEqual, loc, 2);
+                c = c + 2;
+                continue;
+            }
+        }
+        if (*c == '=') {
+            if ((c + 1) != str.end() && *(c + 1) == '=') {
+                tokens.push(TokenKind::Equal, loc, 2);
+                c = c + 2;
+                continue;
+            } else {
+                tokens.push(TokenKind::Assign, loc, 1);
+                ++c;
+                continue;
+            }
+        }
+        if (*c == '<') {
+            if ((c + 1) != str.end() && *(c + 1) == '=') {
+                tokens.push(TokenKind::LessEqual, loc, 2);
+                c = c + 2;
+                continue;
+            } else {
+                tokens.push(TokenKind::Less, loc, 1);
+                ++c;
+                continue;
+            }
+        }
+        if (*c == '>') {
+            if ((c + 1) != str.end() && *(c + 1) == '=') {
+                tokens.push(TokenKind::GreaterEqual, loc, 2);
+                c = c + 2;
+                continue;
+            } else {
+                tokens.push(TokenKind::Greater, loc, 1);
+                ++c;
+                continue;
+            }
+        }
+        if (*c == '+') {
+            tokens.push(TokenKind::Plus, loc, 1);
+            ++c;
+            continue;
+        }
+        if (*c == '-') {
+            tokens.push(TokenKind::Minus, loc, 1);
+            ++c;
+            continue;
+        }
+        if (*c == '/') {
+            tokens.push(TokenKind::Slash, loc, 1);
+            ++c;
+            continue;
+        }
+        if (*c == '*') {
+            tokens.push(TokenKind::Star, loc, 1);
+            ++c;
+            continue;
+        }
+        if (*c == ';') {
+            tokens.push(TokenKind::SemiColon, loc, 1);
+            ++c;
+            continue;
+        }
+        if (*c == '(') {
+            tokens.push(TokenKind::LParen, loc, 1);
+            ++c;
+            continue;
+        }
+        if (*c == ')') {
+            tokens.push(TokenKind::RParen, loc, 1);
+            ++c;
+            continue;
+        }
+
+        if (std::isdigit(*c)) {
+            std::size_t idx;
+            int n = std::stoi(c, &idx);
+            tokens.push_number(loc, idx, n);
+            c += idx;
+            continue;
+        }
+        if (std::isalpha(*c)) {
+            if (str.substr(loc, 6) == "return" && !(c + 6 != str.end() && (std::isalpha(*(c + 6)) || std::isdigit(*(c + 6)) || *(c + 6) == '_'))) {
+                tokens.push(TokenKind::Return, loc, 6);
+                c += 6;
+                continue;
+            } else {
+                auto* p = c + 1;
+                while (p != str.end() && (std::isalpha(*p) || std::isdigit(*p) || *p == '_')) {
+                    ++p;
+                }
+                std::size_t idx = p - c;
+                tokens.push(TokenKind::Identifier, loc, idx);
+                c += idx;
+                continue;
+            }
+        }
+        spdlog::error("Failed to tokenize:");
+        spdlog::error("{}", str);
+        spdlog::error("{:>{}}^ Failed to tokenize", "", loc);
+        std::exit(1);
+    }
+
+    loc = c - str.begin();
+    tokens.push(TokenKind::EndOfFile, loc, 1);
+
+    return tokens;
+}
+
+
+// 識別子・数値・演算子・インデントが混ざった、それらしいソースを生成する
+std::string make_source(std::size_t statements) {
+    std::mt19937 rng(42);
+    std::string src;
+    for (std::size_t i = 0; i < statements; ++i) {
+        src += "    ";
+        src += fmt::format("var_{} = {} * (count_{} + {}) - total <= {};\n",
+                           rng() % 1000, rng() % 100000, rng() % 1000, rng() % 100, rng() % 1000);
+        if (i % 8 == 0) {
+            src += fmt::format("    return result_{} != {};\n", rng() % 100, rng() % 10);
+        }
+    }
+    return src;
+}
+
+template <TokenBuffer (*Tokenize)(std::string_view)>
+void BM_Tokenize(benchmark::State& state) {
+    auto src = make_source(state.range(0));
+    std::size_t tokens = 0;
+    for (auto _ : state) {
+        auto buffer = Tokenize(src);
+        tokens = buffer.size();
+        benchmark::DoNotOptimize(buffer);
+    }
+    state.SetBytesProcessed(state.iterations() * src.size());
+    state.counters["tokens/s"] = benchmark::Counter(
+        static_cast<double>(state.iterations() * tokens), benchmark::Counter::kIsRate);
+}
+
+}
+
+BENCHMARK_TEMPLATE(BM_Tokenize, tokenize)->Arg(1 << 10)->Arg(1 << 12)->Arg(1 << 16);
+// 旧実装はstd::stoiが残りのソース全体をstd::stringにコピーするので入力長の2乗で遅くなる
+BENCHMARK_TEMPLATE(BM_Tokenize, legacy_tokenize)->Arg(1 << 10)->Arg(1 << 12);
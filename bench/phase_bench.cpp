@@ -0,0 +1,331 @@
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+#include <unistd.h>
+
+#include <benchmark/benchmark.h>
+#include <fmt/format.h>
+
+#include "alloc_counter.hpp"
+#include "source_gen.hpp"
+
+#include "asm_writer.hpp"
+#include "compiler.hpp"
+#include "disk_cache.hpp"
+#include "driver.hpp"
+#include "encoder.hpp"
+#include "generator.hpp"
+#include "instr.hpp"
+#include "ir.hpp"
+#include "ir_generator.hpp"
+#include "ir_passes.hpp"
+#include "optimizer.hpp"
+#include "parser.hpp"
+#include "peephole.hpp"
+#include "reg_generator.hpp"
+#include "token.hpp"
+
+using namespace yhok::hokacc;
+using namespace yhok::hokacc::bench;
+
+namespace {
+
+using Generator = std::string (*)(std::size_t);
+
+
+// 各フェーズ共通の指標。件数は1イテレーションあたりの値を渡す
+void report(benchmark::State& state, const std::string& src, std::size_t tokens, std::size_t nodes,
+            std::size_t allocations) {
+    auto iterations = static_cast<double>(state.iterations());
+    state.SetBytesProcessed(state.iterations() * src.size());
+    state.counters["tokens/s"] = benchmark::Counter(iterations * tokens, benchmark::Counter::kIsRate);
+    state.counters["nodes/s"] = benchmark::Counter(iterations * nodes, benchmark::Counter::kIsRate);
+    state.counters["allocs"] = benchmark::Counter(static_cast<double>(allocations), benchmark::Counter::kAvgIterations);
+}
+
+InstrList generate_stack(const Parser& parser) {
+    InstrList code;
+    generate_prologue(parser.frame.frame_size(), code);
+    StackGenerator generator(code);
+    for (const auto& c : parser.code) {
+        generator.generate_stmt(*c);
+    }
+    generate_epilogue(code);
+    return code;
+}
+
+
+template <Generator Generate>
+void BM_Lex(benchmark::State& state) {
+    auto src = Generate(state.range(0));
+    std::size_t tokens = 0;
+    std::size_t allocations = 0;
+    for (auto _ : state) {
+        AllocationScope scope;
+        auto buffer = tokenize(src);
+        allocations += scope.count();
+        tokens = buffer.size();
+        benchmark::DoNotOptimize(buffer);
+    }
+    report(state, src, tokens, 0, allocations);
+}
+
+
+template <Generator Generate>
+void BM_Parse(benchmark::State& state) {
+    auto src = Generate(state.range(0));
+    auto tokens = tokenize(src);
+    std::size_t nodes = 0;
+    std::size_t allocations = 0;
+    for (auto _ : state) {
+        AllocationScope scope;
+        Parser parser(tokens, src);
+        allocations += scope.count();
+        nodes = parser.nodes.size();
+        benchmark::DoNotOptimize(parser.code.data());
+    }
+    report(state, src, tokens.size(), nodes, allocations);
+}
+
+
+// 畳み込みは木を書き換えるので、毎回構文解析し直す (計測には含めない)
+template <Generator Generate>
+void BM_Fold(benchmark::State& state) {
+    auto src = Generate(state.range(0));
+    auto tokens = tokenize(src);
+    std::size_t nodes = 0;
+    std::size_t allocations = 0;
+    for (auto _ : state) {
+        state.PauseTiming();
+        Parser parser(tokens, src);
+        nodes = parser.nodes.size();
+        state.ResumeTiming();
+
+        AllocationScope scope;
+        fold_constants(parser.code, parser.nodes);
+        allocations += scope.count();
+        benchmark::DoNotOptimize(parser.code.data());
+    }
+    report(state, src, tokens.size(), nodes, allocations);
+}
+
+
+template <Generator Generate>
+void BM_CodegenStack(benchmark::State& state) {
+    auto src = Generate(state.range(0));
+    auto tokens = tokenize(src);
+    Parser parser(tokens, src);
+    std::size_t allocations = 0;
+    for (auto _ : state) {
+        AllocationScope scope;
+        auto code = generate_stack(parser);
+        allocations += scope.count();
+        benchmark::DoNotOptimize(code.instrs.data());
+    }
+    report(state, src, tokens.size(), parser.nodes.size(), allocations);
+}
+
+
+template <Generator Generate>
+void BM_CodegenReg(benchmark::State& state) {
+    auto src = Generate(state.range(0));
+    auto tokens = tokenize(src);
+    Parser parser(tokens, src);
+    std::size_t allocations = 0;
+    for (auto _ : state) {
+        AllocationScope scope;
+        InstrList code;
+        RegGenerator generator(code);
+        for (const auto& c : parser.code) {
+            generator.generate_stmt(*c);
+        }
+        allocations += scope.count();
+        benchmark::DoNotOptimize(code.instrs.data());
+    }
+    report(state, src, tokens.size(), parser.nodes.size(), allocations);
+}
+
+
+// 三番地コードへの変換・パス・線形走査による生成をまとめて測る
+template <Generator Generate>
+void BM_CodegenIr(benchmark::State& state) {
+    auto src = Generate(state.range(0));
+    auto tokens = tokenize(src);
+    Parser parser(tokens, src);
+    std::size_t allocations = 0;
+    for (auto _ : state) {
+        AllocationScope scope;
+        auto ir = lower_to_ir(parser.code);
+        auto passes = default_passes();
+        passes.run(ir);
+        InstrList code;
+        generate_ir(ir, code);
+        allocations += scope.count();
+        benchmark::DoNotOptimize(code.instrs.data());
+    }
+    report(state, src, tokens.size(), parser.nodes.size(), allocations);
+}
+
+
+template <Generator Generate>
+void BM_Peephole(benchmark::State& state) {
+    auto src = Generate(state.range(0));
+    auto tokens = tokenize(src);
+    Parser parser(tokens, src);
+    auto original = generate_stack(parser);
+    PeepholeOptions options;
+    std::size_t allocations = 0;
+    for (auto _ : state) {
+        state.PauseTiming();
+        auto code = original;
+        state.ResumeTiming();
+
+        AllocationScope scope;
+        optimize_peephole(code, options);
+        allocations += scope.count();
+        benchmark::DoNotOptimize(code.instrs.data());
+    }
+    report(state, src, tokens.size(), parser.nodes.size(), allocations);
+}
+
+
+template <Generator Generate>
+void BM_EmitAsm(benchmark::State& state) {
+    auto src = Generate(state.range(0));
+    auto tokens = tokenize(src);
+    Parser parser(tokens, src);
+    auto code = generate_stack(parser);
+    std::size_t allocations = 0;
+    for (auto _ : state) {
+        AllocationScope scope;
+        auto out = AsmWriter::to_memory();
+        emit_asm(code, out);
+        allocations += scope.count();
+        benchmark::DoNotOptimize(out.str().data());
+    }
+    report(state, src, tokens.size(), parser.nodes.size(), allocations);
+}
+
+
+template <Generator Generate>
+void BM_Encode(benchmark::State& state) {
+    auto src = Generate(state.range(0));
+    auto tokens = tokenize(src);
+    Parser parser(tokens, src);
+    auto code = generate_stack(parser);
+    std::size_t allocations = 0;
+    for (auto _ : state) {
+        AllocationScope scope;
+        auto bytes = encode(code);
+        allocations += scope.count();
+        benchmark::DoNotOptimize(bytes.data());
+    }
+    report(state, src, tokens.size(), parser.nodes.size(), allocations);
+}
+
+
+// ソースから命令列まで (-O1, 既定のバックエンド)
+template <Generator Generate>
+void BM_Compile(benchmark::State& state) {
+    auto src = Generate(state.range(0));
+    auto tokens = tokenize(src).size();
+    std::size_t allocations = 0;
+    for (auto _ : state) {
+        AllocationScope scope;
+        auto code = compile(src);
+        allocations += scope.count();
+        benchmark::DoNotOptimize(code.instrs.data());
+    }
+    report(state, src, tokens, 0, allocations);
+}
+
+
+// 文ごとに生成して書き出す経路。確保回数が入力の大きさによらないことを確かめる
+template <Generator Generate>
+void BM_CompileStreaming(benchmark::State& state) {
+    auto src = Generate(state.range(0));
+    auto tokens = tokenize(src).size();
+    std::size_t allocations = 0;
+    for (auto _ : state) {
+        AllocationScope scope;
+        auto out = AsmWriter::to_file("/dev/null");
+        compile_streaming(src, {}, out);
+        allocations += scope.count();
+    }
+    report(state, src, tokens, 0, allocations);
+}
+
+
+// 1文だけ書き換えたソースを交互にコンパイルし直す。書き換えていない文は覚えた出力を使う
+template <Generator Generate>
+void BM_CompileIncremental(benchmark::State& state) {
+    auto src = Generate(state.range(0));
+    auto edited = "edited = 1;\n" + src.substr(src.find('\n') + 1);
+    auto tokens = tokenize(src).size();
+    StreamingCompiler compiler(true);
+    {
+        auto out = AsmWriter::to_file("/dev/null");
+        compiler.compile(src, {}, out);
+        compiler.compile(edited, {}, out);
+    }
+    std::size_t allocations = 0;
+    bool flip = false;
+    for (auto _ : state) {
+        AllocationScope scope;
+        auto out = AsmWriter::to_file("/dev/null");
+        compiler.compile(flip ? edited : src, {}, out);
+        allocations += scope.count();
+        flip = !flip;
+    }
+    report(state, src, tokens, 0, allocations);
+}
+
+
+// ディスクのキャッシュにヒットしたときのコスト。ハッシュを1回求め、保存した出力を1回写す
+template <Generator Generate>
+void BM_CacheHit(benchmark::State& state) {
+    auto src = Generate(state.range(0));
+    auto tokens = tokenize(src).size();
+    auto dir = fmt::format("/tmp/hokacc_bench_cache_{}", ::getpid());
+    {
+        DiskCache cache(dir, std::uint64_t(1) << 30, "bench");
+        auto out = AsmWriter::to_file("/dev/null");
+        compile_cached(src, {}, Emit::Asm, out, cache);
+        std::size_t allocations = 0;
+        for (auto _ : state) {
+            AllocationScope scope;
+            compile_cached(src, {}, Emit::Asm, out, cache);
+            allocations += scope.count();
+        }
+        if (cache.misses != 1) {
+            state.SkipWithError("cache missed");
+        }
+        report(state, src, tokens, 0, allocations);
+    }
+    std::filesystem::remove_all(dir);
+}
+
+}
+
+// 入力の形ごとに小さい・大きいの2つの大きさで測る
+#define HOKACC_PHASE_BENCHMARK(bm) \
+    BENCHMARK_TEMPLATE(bm, arithmetic_chain)->Arg(1 << 10)->Arg(1 << 14)->Unit(benchmark::kMicrosecond); \
+    BENCHMARK_TEMPLATE(bm, nested_parens)->Arg(1 << 10)->Arg(1 << 14)->Unit(benchmark::kMicrosecond); \
+    BENCHMARK_TEMPLATE(bm, distinct_variables)->Arg(1 << 10)->Arg(1 << 14)->Unit(benchmark::kMicrosecond); \
+    BENCHMARK_TEMPLATE(bm, many_statements)->Arg(1 << 14)->Arg(1 << 20)->Unit(benchmark::kMicrosecond)
+
+HOKACC_PHASE_BENCHMARK(BM_Lex);
+HOKACC_PHASE_BENCHMARK(BM_Parse);
+HOKACC_PHASE_BENCHMARK(BM_Fold);
+HOKACC_PHASE_BENCHMARK(BM_CodegenStack);
+HOKACC_PHASE_BENCHMARK(BM_CodegenReg);
+HOKACC_PHASE_BENCHMARK(BM_CodegenIr);
+HOKACC_PHASE_BENCHMARK(BM_Peephole);
+HOKACC_PHASE_BENCHMARK(BM_EmitAsm);
+HOKACC_PHASE_BENCHMARK(BM_Encode);
+HOKACC_PHASE_BENCHMARK(BM_Compile);
+HOKACC_PHASE_BENCHMARK(BM_CompileStreaming);
+HOKACC_PHASE_BENCHMARK(BM_CacheHit);
+BENCHMARK_TEMPLATE(BM_CompileIncremental, many_statements)->Arg(1 << 14)->Arg(1 << 17)->Unit(benchmark::kMicrosecond);
@@ -0,0 +1,245 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <fmt/core.h>
+#include <spdlog/spdlog.h>
+#include <spdlog/sinks/stdout_color_sinks.h>
+
+#include "compiler.hpp"
+#include "driver.hpp"
+#include "encoder.hpp"
+#include "error.hpp"
+#include "jit.hpp"
+#include "mapped_file.hpp"
+
+using namespace yhok::hokacc;
+
+namespace {
+
+// 生成したコードの速さを測る。プログラムごとにコンパイルしてその場で実行可能なメモリに置き、
+// 何度も呼んで1回あたりのサイクル数・リタイアした命令数・時間を求める。
+// 生成したコードは数十ナノ秒で終わるので、プロセスを起動して測るとほとんどが起動の時間になる
+
+
+// ユーザ空間のサイクル数とリタイアした命令数を読むperfのカウンタ。
+// コンテナなどで使えなければvalid()がfalseになり、時間だけを測る
+struct PerfCounters {
+    PerfCounters() {
+        cycles = open(PERF_COUNT_HW_CPU_CYCLES, -1);
+        if (cycles < 0) {
+            return;
+        }
+        instructions = open(PERF_COUNT_HW_INSTRUCTIONS, cycles);
+        if (instructions < 0) {
+            ::close(std::exchange(cycles, -1));
+        }
+    }
+
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    ~PerfCounters() {
+        if (instructions >= 0) {
+            ::close(instructions);
+        }
+        if (cycles >= 0) {
+            ::close(cycles);
+        }
+    }
+
+    bool valid() const {
+        return cycles >= 0;
+    }
+
+    void start() {
+        ::ioctl(cycles, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ::ioctl(cycles, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+
+    // (サイクル数, 命令数)
+    std::pair<std::uint64_t, std::uint64_t> stop() {
+        ::ioctl(cycles, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+        std::uint64_t values[3] = {};  // 数, サイクル数, 命令数
+        if (::read(cycles, values, sizeof(values)) != sizeof(values)) {
+            fail("Failed to read perf counters: {}", std::strerror(errno));
+        }
+        return {values[1], values[2]};
+    }
+
+private:
+    int cycles = -1;  // グループのリーダー
+    int instructions = -1;
+
+    static int open(std::uint64_t config, int group) {
+        perf_event_attr attr{};
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = config;
+        attr.disabled = group < 0;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP;
+        return static_cast<int>(::syscall(SYS_perf_event_open, &attr, 0, -1, group, 0));
+    }
+};
+
+
+std::uint64_t now_ns() {
+    timespec ts;
+    ::clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<std::uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+
+struct Result {
+    std::size_t statements = 0;
+    std::size_t instrs = 0;  // 生成した命令の数
+    std::size_t executed = 0;  // 最初のretまでの命令の数。分岐がないので1回の実行で必ず実行される
+    std::size_t bytes = 0;  // 機械語の大きさ
+    double ns = 0;  // 1回あたり。以下も同じ
+    std::optional<double> cycles;
+    std::optional<double> instructions;
+};
+
+
+// runs回の呼び出しをbatches回測り、最も速かった回の1回あたりの値を取る
+Result measure(std::string_view source, const CompileOptions& options, std::size_t runs, std::size_t batches,
+               PerfCounters& counters) {
+    Result result;
+    auto tokens = tokenize(source);
+    for (std::size_t i = 0; i < tokens.size(); ++i) {
+        if (tokens.kind(i) == TokenKind::SemiColon) {
+            ++result.statements;
+        }
+    }
+    auto code = compile(source, options);
+    result.instrs = code.size();
+    auto ret = std::find_if(code.instrs.begin(), code.instrs.end(), [](const Instr& instr) {
+        return instr.op == Op::Ret;
+    });
+    result.executed = std::min(code.size(), static_cast<std::size_t>(ret - code.instrs.begin()) + 1);
+    auto text = encode(code);
+    result.bytes = text.size();
+
+    auto jit = JitCode::load(text);
+    auto entry = jit.entry();
+    entry();
+    for (std::size_t batch = 0; batch < batches; ++batch) {
+        if (counters.valid()) {
+            counters.start();
+        }
+        auto start = now_ns();
+        for (std::size_t i = 0; i < runs; ++i) {
+            entry();
+        }
+        auto ns = static_cast<double>(now_ns() - start) / runs;
+        if (counters.valid()) {
+            auto [cycles, instructions] = counters.stop();
+            result.cycles = std::min(result.cycles.value_or(1e300), static_cast<double>(cycles) / runs);
+            result.instructions = std::min(result.instructions.value_or(1e300), static_cast<double>(instructions) / runs);
+        }
+        result.ns = batch == 0 ? ns : std::min(result.ns, ns);
+    }
+    return result;
+}
+
+
+std::string json_string(std::string_view s) {
+    std::string out = "\"";
+    for (char c : s) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+        }
+        out += c;
+    }
+    return out + "\"";
+}
+
+std::string json_number(std::optional<double> value) {
+    return value ? fmt::format("{:.2f}", *value) : "null";
+}
+
+
+int usage(const char* argv0) {
+    fmt::print("Usage: {} [-O0|-O1] [--backend=stack|reg|ir] [options...] [--runs=<n>] [--batches=<n>] <file>...\n",
+               argv0);
+    return 1;
+}
+
+}
+
+
+// プログラムのファイルを1つずつ測り、結果をJSONの配列として標準出力に書く
+int main(int argc, char* argv[]) {
+    auto err_logger = spdlog::stderr_color_mt("stderr");
+    spdlog::set_default_logger(err_logger);
+
+    CompileOptions options;
+    Emit emit = Emit::Jit;
+    std::size_t runs = 10000;
+    std::size_t batches = 5;
+    std::vector<std::string> files;
+    try {
+        for (int i = 1; i < argc; ++i) {
+            std::string_view arg = argv[i];
+            if (arg.substr(0, 7) == "--runs=") {
+                runs = std::max<std::size_t>(std::stoul(std::string(arg.substr(7))), 1);
+            } else if (arg.substr(0, 10) == "--batches=") {
+                batches = std::max<std::size_t>(std::stoul(std::string(arg.substr(10))), 1);
+            } else if (arg.substr(0, 1) == "-") {
+                if (!parse_compile_flag(arg, options, emit)) {
+                    return usage(argv[0]);
+                }
+            } else {
+                files.emplace_back(arg);
+            }
+        }
+    } catch (const std::exception& error) {
+        spdlog::error("{}", error.what());
+        return usage(argv[0]);
+    }
+    if (files.empty()) {
+        return usage(argv[0]);
+    }
+
+    PerfCounters counters;
+    if (!counters.valid()) {
+        spdlog::warn("perf counters are not available; measuring time only");
+    }
+
+    try {
+        fmt::print("[\n");
+        for (std::size_t i = 0; i < files.size(); ++i) {
+            auto file = MappedFile::open(files[i]);
+            auto r = measure(file.view(), options, runs, batches, counters);
+            auto per_statement = [&](std::size_t n) {
+                return fmt::format("{:.2f}", static_cast<double>(n) / std::max<std::size_t>(r.statements, 1));
+            };
+            fmt::print("  {{\"program\": {}, \"statements\": {}, \"instrs\": {}, \"executed\": {}, \"bytes\": {}, "
+                       "\"instrs_per_statement\": {}, \"bytes_per_statement\": {}, "
+                       "\"runs\": {}, \"ns\": {:.2f}, \"cycles\": {}, \"instructions\": {}}}{}\n",
+                       json_string(files[i]), r.statements, r.instrs, r.executed, r.bytes,
+                       per_statement(r.instrs), per_statement(r.bytes),
+                       runs, r.ns, json_number(r.cycles), json_number(r.instructions),
+                       i + 1 < files.size() ? "," : "");
+        }
+        fmt::print("]\n");
+    } catch (const CompileError& error) {
+        spdlog::error("{}", error.what());
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,92 @@
+#include <cstddef>
+#include <string>
+
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <benchmark/benchmark.h>
+#include <fmt/format.h>
+
+#include "source_gen.hpp"
+
+#include "server.hpp"
+
+using namespace yhok::hokacc;
+using namespace yhok::hokacc::bench;
+
+extern char** environ;
+
+namespace {
+
+// 同じ小さなプログラムを繰り返しコンパイルさせ、1秒あたりに返せる要求の数を比べる。
+// 短いプログラムほど、プロセスの起動にかかる時間がコンパイルそのものより効いてくる
+constexpr std::size_t server_workers = 4;
+
+
+std::string socket_path() {
+    return fmt::format("/tmp/hokacc_bench_{}.sock", ::getpid());
+}
+
+// プロセス内で1つだけ立てるサーバ。ベンチマークの全スレッドが共有し、終了時に止める
+CompileServer& shared_server() {
+    static CompileServer server(socket_path(), server_workers);
+    return server;
+}
+
+
+// 各スレッドが自分の接続を張り、応答を待ってから次の要求を送る
+void BM_ServerRequests(benchmark::State& state) {
+    shared_server();
+    auto src = many_statements(state.range(0));
+    auto client = CompileClient::connect(socket_path());
+    std::string output;
+    for (auto _ : state) {
+        if (client.request("-O1", src, output) != ResponseStatus::Ok) {
+            state.SkipWithError("compile error");
+            break;
+        }
+        benchmark::DoNotOptimize(output.data());
+    }
+    state.counters["requests/s"] = benchmark::Counter(static_cast<double>(state.iterations()),
+                                                      benchmark::Counter::kIsRate);
+}
+
+
+// 比較のため、要求ごとにhokaccのプロセスを起動して出力を捨てる
+void BM_ProcessPerCompile(benchmark::State& state) {
+    // ベンチマークと同じディレクトリにあるhokaccを使う
+    char self[4096];
+    auto length = ::readlink("/proc/self/exe", self, sizeof(self) - 1);
+    if (length < 0) {
+        state.SkipWithError("cannot locate the benchmark binary");
+        return;
+    }
+    auto path = std::string(self, length);
+    path = path.substr(0, path.rfind('/') + 1) + "hokacc";
+    auto src = many_statements(state.range(0));
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+    char* argv[] = {path.data(), const_cast<char*>("-O1"), src.data(), nullptr};
+    for (auto _ : state) {
+        pid_t pid;
+        int status = 0;
+        if (::posix_spawn(&pid, path.c_str(), &actions, nullptr, argv, environ) != 0 ||
+            ::waitpid(pid, &status, 0) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            state.SkipWithError("failed to run hokacc");
+            break;
+        }
+    }
+    posix_spawn_file_actions_destroy(&actions);
+    state.counters["requests/s"] = benchmark::Counter(static_cast<double>(state.iterations()),
+                                                      benchmark::Counter::kIsRate);
+}
+
+}
+
+
+BENCHMARK(BM_ServerRequests)->Arg(16)->Arg(1 << 10)->Threads(1)->Threads(server_workers)->UseRealTime();
+BENCHMARK(BM_ProcessPerCompile)->Arg(16)->Arg(1 << 10)->Threads(1)->Threads(server_workers)->UseRealTime();
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstddef>
+#include <random>
+#include <string>
+
+#include <fmt/format.h>
+
+namespace yhok::hokacc::bench {
+
+// 1つの長い式文: v0 + 17 * v1 - 3 + ... (左に深い木になる)
+inline std::string arithmetic_chain(std::size_t terms) {
+    static constexpr const char* ops[] = {" + ", " - ", " * ", " / "};
+    std::mt19937 rng(1);
+    std::string src = "v0 = 1; v1 = 2; v2 = 3; v0";
+    for (std::size_t i = 1; i < terms; ++i) {
+        src += ops[rng() % 4];
+        if (i % 3 == 0) {
+            src += fmt::format("v{}", rng() % 3);
+        } else {
+            src += fmt::format("{}", rng() % 1000 + 1);
+        }
+    }
+    src += ";\n";
+    return src;
+}
+
+// depth段の括弧の入れ子: (1 + (2 * (3 - (...))))
+inline std::string nested_parens(std::size_t depth) {
+    std::string src;
+    src.reserve(depth * 6 + 4);
+    for (std::size_t i = 0; i < depth; ++i) {
+        src += fmt::format("({} {} ", i % 9 + 1, i % 2 == 0 ? '+' : '*');
+    }
+    src += '1';
+    src.append(depth, ')');
+    src += ";\n";
+    return src;
+}
+
+// 互いに異なるcount個の変数を順に定義する
+inline std::string distinct_variables(std::size_t count) {
+    std::string src = "variable_0 = 1;\n";
+    for (std::size_t i = 1; i < count; ++i) {
+        src += fmt::format("variable_{} = variable_{} + {};\n", i, i - 1, i % 100);
+    }
+    return src;
+}
+
+// 少数の変数を使う短い文をcount個並べる
+inline std::string many_statements(std::size_t count) {
+    std::mt19937 rng(2);
+    std::string src;
+    src.reserve(count * 24);
+    for (std::size_t i = 0; i < count; ++i) {
+        auto a = rng() % 8;
+        auto b = rng() % 8;
+        src += fmt::format("x{} = x{} * {} + {};\n", a, b, rng() % 50, rng() % 1000);
+    }
+    return src;
+}
+
+}
@@ -0,0 +1,43 @@
+// operator newを置き換え、--statsやベンチマークがフェーズごとの確保を数えられるようにする。
+// 数えるのはスレッドローカルな加算だけなので、--statsを付けないときもそのままにしておく
+
+#include <cstdlib>
+#include <new>
+
+#include "stats.hpp"
+
+namespace {
+
+void* counted_alloc(std::size_t size) {
+    yhok::hokacc::AllocationCounter::record(size);
+    if (void* p = std::malloc(size == 0 ? 1 : size)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+}
+
+void* operator new(std::size_t size) {
+    return counted_alloc(size);
+}
+
+void* operator new[](std::size_t size) {
+    return counted_alloc(size);
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept {
+    std::free(p);
+}
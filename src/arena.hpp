@@ -0,0 +1,135 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+// CMakeのHOKACC_USE_ARENAで切り替える (0にすると1オブジェクトごとにヒープ確保する)
+#ifndef HOKACC_USE_ARENA
+#define HOKACC_USE_ARENA 1
+#endif
+
+namespace yhok::hokacc {
+
+// Tを連続したチャンクに詰めて確保するバンプポインタアロケータ。
+// 個々のオブジェクトは解放せず、アリーナの破棄時にチャンク単位でまとめて解放する。
+template <typename T>
+struct ObjectArena {
+    static_assert(std::is_trivially_destructible_v<T>, "ObjectArena never runs destructors");
+
+    static constexpr std::size_t initial_chunk_size = 256;
+
+    ObjectArena() = default;
+    ObjectArena(const ObjectArena&) = delete;
+    ObjectArena& operator=(const ObjectArena&) = delete;
+    ObjectArena(ObjectArena&&) = default;
+    ObjectArena& operator=(ObjectArena&&) = default;
+
+    T* create() {
+        ++count;
+#if HOKACC_USE_ARENA
+        if (used == chunk_size) {
+            grow();
+        }
+        return new (&chunks.back()[used++]) T{};
+#else
+        heap.push_back(std::make_unique<T>());
+        return heap.back().get();
+#endif
+    }
+
+    // これまでに確保したオブジェクトの数
+    std::size_t size() const {
+        return count;
+    }
+
+    // 確保したオブジェクトを全て捨てる。最後の (最大の) チャンクは次の確保に再利用する
+    void clear() {
+        count = 0;
+#if HOKACC_USE_ARENA
+        if (chunks.size() > 1) {
+            auto last = std::move(chunks.back());
+            chunks.clear();
+            chunks.push_back(std::move(last));
+        }
+        used = 0;
+#else
+        heap.clear();
+#endif
+    }
+
+private:
+    struct alignas(T) Slot {
+        std::byte bytes[sizeof(T)];
+    };
+
+    std::size_t count = 0;
+#if HOKACC_USE_ARENA
+    std::vector<std::unique_ptr<Slot[]>> chunks;
+    std::size_t chunk_size = 0;
+    std::size_t used = 0;
+
+    void grow() {
+        // チャンクの大きさを倍々にして、チャンク数を確保数の対数に抑える
+        chunk_size = chunk_size == 0 ? initial_chunk_size : chunk_size * 2;
+        chunks.push_back(std::unique_ptr<Slot[]>(new Slot[chunk_size]));
+        used = 0;
+    }
+#else
+    std::vector<std::unique_ptr<T>> heap;
+#endif
+};
+
+
+// 文字列をコピーして持つアリーナ。チャンクは動かないので、返したstring_viewはアリーナの破棄まで有効
+struct StringArena {
+    static constexpr std::size_t chunk_size = 4096;
+
+    StringArena() = default;
+    StringArena(const StringArena&) = delete;
+    StringArena& operator=(const StringArena&) = delete;
+    StringArena(StringArena&&) = default;
+    StringArena& operator=(StringArena&&) = default;
+
+    std::string_view copy(std::string_view str) {
+        if (str.size() > rest) {
+            // チャンクより長い文字列はそれだけで1つのチャンクにする
+            auto size = std::max(chunk_size, str.size());
+            chunks.push_back(std::unique_ptr<char[]>(new char[size]));
+            next = chunks.back().get();
+            rest = size;
+        }
+        char* p = next;
+        std::memcpy(p, str.data(), str.size());
+        next += str.size();
+        rest -= str.size();
+        return std::string_view(p, str.size());
+    }
+
+    // コピーした文字列を全て捨てる。最後のチャンクは次のコピーに再利用する
+    void clear() {
+        if (chunks.empty()) {
+            return;
+        }
+        if (chunks.size() > 1) {
+            auto last = std::move(chunks.back());
+            chunks.clear();
+            chunks.push_back(std::move(last));
+        }
+        // 最後のチャンクが長い文字列1つ分の大きさでも、少なくともchunk_sizeはある
+        next = chunks.back().get();
+        rest = chunk_size;
+    }
+
+private:
+    std::vector<std::unique_ptr<char[]>> chunks;
+    char* next = nullptr;
+    std::size_t rest = 0;
+};
+
+}
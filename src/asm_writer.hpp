@@ -0,0 +1,136 @@
+#pragma once
+
+#include <cerrno>
+#include <cstring>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <fmt/format.h>
+#include <spdlog/spdlog.h>
+
+#include "error.hpp"
+
+namespace yhok::hokacc {
+
+// 生成したアセンブリを伸長するバッファに書式化しておき、まとめてwrite(2)する。
+// 出力先はファイル・標準出力・メモリ (テスト用) のいずれか
+struct AsmWriter {
+    // これを超えたら書き出す。メモリへの出力では書き出さない
+    static constexpr std::size_t flush_threshold = 1 << 20;
+
+    static AsmWriter to_stdout() {
+        return AsmWriter(STDOUT_FILENO, false);
+    }
+
+    static AsmWriter to_file(const std::string& path) {
+        int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            fail("Failed to open {}: {}", path, std::strerror(errno));
+        }
+        return AsmWriter(fd, true);
+    }
+
+    static AsmWriter to_memory() {
+        return AsmWriter(-1, false);
+    }
+
+    AsmWriter(const AsmWriter&) = delete;
+    AsmWriter& operator=(const AsmWriter&) = delete;
+
+    AsmWriter(AsmWriter&& other)
+        : buffer(std::move(other.buffer)), fd(std::exchange(other.fd, -1)), owns_fd(std::exchange(other.owns_fd, false)) {}
+
+    AsmWriter& operator=(AsmWriter&&) = delete;
+
+    // 書き出しの失敗を知りたければ、破棄する前にflushを呼ぶ
+    ~AsmWriter() {
+        try {
+            flush();
+        } catch (const CompileError& error) {
+            spdlog::error("{}", error.what());
+        }
+        if (owns_fd) {
+            ::close(fd);
+        }
+    }
+
+    template <typename... Args>
+    void print(fmt::format_string<Args...> format, Args&&... args) {
+        fmt::format_to(std::back_inserter(buffer), format, std::forward<Args>(args)...);
+        if (fd >= 0 && buffer.size() >= flush_threshold) {
+            flush();
+        }
+    }
+
+    // 書式化せずにバイト列をそのまま追加する (オブジェクトファイル用)
+    void write(const void* data, std::size_t size) {
+        auto p = static_cast<const char*>(data);
+        buffer.append(p, p + size);
+        if (fd >= 0 && buffer.size() >= flush_threshold) {
+            flush();
+        }
+    }
+
+    // 大きなバイト列をバッファを通さずに書き出す。メモリへの出力ではwriteと同じ
+    void write_through(const void* data, std::size_t size) {
+        if (fd < 0) {
+            write(data, size);
+            return;
+        }
+        flush();
+        write_fd(static_cast<const char*>(data), size);
+    }
+
+    // バッファの中身を出力先に書き出す
+    void flush() {
+        if (fd < 0) {
+            return;
+        }
+        // 失敗しても同じ内容を二度書かないように、バッファは必ず空にする
+        try {
+            write_fd(buffer.data(), buffer.size());
+        } catch (const CompileError&) {
+            buffer.clear();
+            throw;
+        }
+        buffer.clear();
+    }
+
+    // メモリへ出力した内容
+    std::string_view str() const {
+        return std::string_view(buffer.data(), buffer.size());
+    }
+
+    // メモリへ出力した内容を捨てる。確保したバッファは次の出力に使い回す
+    void clear() {
+        buffer.clear();
+    }
+
+private:
+    AsmWriter(int fd, bool owns_fd) : fd(fd), owns_fd(owns_fd) {}
+
+    void write_fd(const char* p, std::size_t rest) {
+        while (rest > 0) {
+            auto n = ::write(fd, p, rest);
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                fail("Failed to write output: {}", std::strerror(errno));
+            }
+            p += n;
+            rest -= n;
+        }
+    }
+
+    fmt::memory_buffer buffer;
+    int fd;
+    bool owns_fd;
+};
+
+}
@@ -0,0 +1,51 @@
+#include <cstdio>
+#include <string>
+#include <string_view>
+
+#include <fmt/core.h>
+#include <spdlog/spdlog.h>
+#include <spdlog/sinks/stdout_color_sinks.h>
+
+#include "error.hpp"
+#include "server.hpp"
+
+using namespace yhok::hokacc;
+
+
+int usage(const char* argv0) {
+    fmt::print("Usage: {} <socket> [-O0|-O1] [--backend=stack|reg|ir] [--emit=asm|obj] [options...] <string>\n", argv0);
+    return 1;
+}
+
+
+// hokacc --server=<socket> にプログラムを1つ送り、出力を標準出力に書く。
+// コンパイルの引数はそのままサーバに渡す
+int main(int argc, char* argv[]) {
+    auto err_logger = spdlog::stderr_color_mt("stderr");
+    spdlog::set_default_logger(err_logger);
+
+    if (argc < 3) {
+        return usage(argv[0]);
+    }
+    std::string flags;
+    for (int i = 2; i < argc - 1; ++i) {
+        if (!flags.empty()) {
+            flags += ' ';
+        }
+        flags += argv[i];
+    }
+
+    try {
+        auto client = CompileClient::connect(argv[1]);
+        std::string output;
+        if (client.request(flags, argv[argc - 1], output) != ResponseStatus::Ok) {
+            report_error(CompileError(output), *err_logger);
+            return 1;
+        }
+        std::fwrite(output.data(), 1, output.size(), stdout);
+    } catch (const CompileError& error) {
+        report_error(error, *err_logger);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,268 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include <spdlog/spdlog.h>
+
+#include "error.hpp"
+#include "token.hpp"
+#include "parser.hpp"
+#include "optimizer.hpp"
+#include "generator.hpp"
+#include "reg_generator.hpp"
+#include "instr.hpp"
+#include "peephole.hpp"
+#include "ir.hpp"
+#include "ir_passes.hpp"
+#include "ir_generator.hpp"
+#include "trace.hpp"
+#include "asm_writer.hpp"
+#include "stats.hpp"
+
+namespace yhok::hokacc {
+
+enum struct Backend {
+    Stack,  // 一時値を全てスタックに積む
+    Reg,    // 一時値をレジスタに割り当てる
+    Ir,     // 三番地コードを経由し、線形走査でレジスタを割り当てる
+};
+
+
+struct CompileOptions {
+    int opt_level = 1;  // 0なら最適化しない
+    Backend backend = Backend::Stack;
+    std::optional<bool> peephole;  // 未指定なら最適化レベルに従う
+    PeepholeOptions peephole_options;
+    bool peephole_stats = false;
+    bool time_passes = false;
+};
+
+
+inline void report_peephole(const PeepholeStats& stats, std::size_t remaining) {
+    for (std::size_t i = 0; i < peephole_rule_count; ++i) {
+        spdlog::info("peephole {}: {} removed", peephole_rule_names[i], stats.removed[i]);
+    }
+    spdlog::info("peephole: {} -> {} instructions", remaining + stats.total(), remaining);
+}
+
+
+// 出力を変えるオプションだけをバイト列にしてkeyに追記する。統計や時間の表示は出力を変えないので含めない
+inline void append_output_options(std::string& key, const CompileOptions& options) {
+    bool peephole = options.peephole.value_or(options.opt_level > 0);
+    key += static_cast<char>(options.opt_level);
+    key += static_cast<char>(options.backend);
+    key += static_cast<char>(peephole);
+    if (peephole) {
+        for (bool enabled : options.peephole_options.enabled) {
+            key += static_cast<char>(enabled);
+        }
+        auto window = static_cast<std::uint32_t>(options.peephole_options.window);
+        key.append(reinterpret_cast<const char*>(&window), sizeof(window));
+    }
+}
+
+
+// ソースからmain関数1つ分の命令列を生成する。statsがあれば、フェーズごとの時間と確保、入力の規模を記録する
+inline InstrList compile(std::string_view source, const CompileOptions& options = {}, CompileStats* stats = nullptr) {
+    PhaseClock clock(stats);
+    auto tokens = tokenize(source);
+    clock.lap("lex");
+    Parser parser(tokens, source, options.opt_level > 0);
+    clock.lap("parse");
+    if (options.opt_level > 0) {
+        fold_constants(parser.code, parser.nodes);
+        clock.lap("fold");
+    }
+
+    InstrList code;
+    if (options.backend == Backend::Ir) {
+        auto ir = lower_to_ir(parser.code);
+        clock.lap("lower");
+        if (options.opt_level > 0) {
+            auto passes = default_passes();
+            passes.run(ir, &clock);
+            if (options.time_passes) {
+                passes.report();
+            }
+        }
+        generate_ir(ir, code, options.opt_level > 0);
+    } else {
+        generate_prologue(parser.frame.frame_size(), code);
+        if (options.backend == Backend::Reg) {
+            RegGenerator generator(code);
+            generator.use_immediates = options.opt_level > 0;
+            for (const auto& c : parser.code) {
+                generator.generate_stmt(*c);
+            }
+        } else {
+            StackGenerator generator(code);
+            generator.use_immediates = options.opt_level > 0;
+            for (const auto& c : parser.code) {
+                generator.generate_stmt(*c);
+            }
+        }
+        generate_epilogue(code);
+    }
+    HOKACC_TRACE(Codegen, "generated {} instructions", code.size());
+    clock.lap("codegen");
+
+    if (options.peephole.value_or(options.opt_level > 0)) {
+        auto peephole_stats = optimize_peephole(code, options.peephole_options);
+        if (options.peephole_stats) {
+            report_peephole(peephole_stats, code.size());
+        }
+        clock.lap("peephole");
+    }
+
+    if (stats) {
+        stats->input_bytes = source.size();
+        stats->tokens = tokens.size();
+        stats->nodes = parser.nodes.size();
+        stats->variables = parser.frame.order.size();
+        stats->instrs = code.size();
+    }
+    return code;
+}
+
+
+// 文ごとに生成したアセンブリを、文の中身 (Parser::skim_statementのキー) とオプションで引く表。
+// 1文だけ書き換えたプログラムを再びコンパイルすると、書き換えていない文は構文解析もコード生成もしない
+struct StatementCache {
+    // 持っている文字列の合計がこれを超えたら全て捨てる
+    static constexpr std::size_t max_bytes = std::size_t(64) << 20;
+
+    // 出力を変えるオプションをキーの先頭に書く
+    static void begin_key(std::string& key, const CompileOptions& options) {
+        key.clear();
+        append_output_options(key, options);
+    }
+
+    const std::string* find(const std::string& key) const {
+        auto it = fragments.find(key);
+        return it == fragments.end() ? nullptr : &it->second;
+    }
+
+    void insert(const std::string& key, std::string_view fragment) {
+        bytes += key.size() + fragment.size();
+        if (bytes > max_bytes) {
+            fragments.clear();
+            bytes = key.size() + fragment.size();
+        }
+        fragments.insert_or_assign(key, std::string(fragment));
+    }
+
+private:
+    std::unordered_map<std::string, std::string> fragments;
+    std::size_t bytes = 0;
+};
+
+
+// 文ごとに構文解析・コード生成してすぐに書き出す。
+// トークンは先読み分、構文木と命令列は1文分しか持たないので、使うメモリはソースの長さによらない。
+// 全体を見る必要がある三番地コードのバックエンドには使えない。
+// 1つのStreamingCompilerで続けてコンパイルすると、アリーナや命令列のバッファを確保し直さずに使い回す。
+// incrementalなら文ごとの出力をStatementCacheに覚えておき、前のコンパイルと同じ文は覚えた出力をそのまま書く
+struct StreamingCompiler {
+    explicit StreamingCompiler(bool incremental = false) : incremental(incremental) {}
+    StreamingCompiler(const StreamingCompiler&) = delete;
+    StreamingCompiler& operator=(const StreamingCompiler&) = delete;
+
+    void compile(std::string_view source, const CompileOptions& options, AsmWriter& out) {
+        if (options.backend == Backend::Ir) {
+            fail("The IR backend cannot compile statement by statement");
+        }
+        bool peephole = options.peephole.value_or(options.opt_level > 0);
+        peephole_options = options.peephole_options;
+        optimizer.stats = {};
+        std::size_t instr_count = 0;
+        // 覚えた文の命令は数えられないので、統計を取るときは使わない
+        bool use_cache = incremental && !(peephole && options.peephole_stats);
+
+        code.instrs.clear();
+        auto flush = [&](AsmWriter& to) {
+            if (peephole) {
+                optimizer.run(code);
+            }
+            instr_count += code.size();
+            emit_asm_instrs(code, to);
+            code.instrs.clear();
+        };
+
+        stack_generator.use_immediates = options.opt_level > 0;
+        reg_generator.use_immediates = options.opt_level > 0;
+        parser.restart(source, options.opt_level > 0);
+        emit_asm_header(out);
+        generate_prologue(parser.frame.frame_size(), code);
+        // 覚えた文の出力にプロローグが混ざらないように先に書く
+        if (use_cache) {
+            flush(out);
+        }
+        while (!parser.consumer.at_eof()) {
+            // 文を読み飛ばしてキーを作り、覚えていればそれを書く。
+            // 字句解析のエラーなどで読み飛ばせなければ、構文解析してエラーを報告させる
+            bool cacheable = false;
+            if (use_cache) {
+                auto start = parser.consumer.offset();
+                StatementCache::begin_key(key, options);
+                try {
+                    cacheable = parser.skim_statement(key);
+                } catch (const CompileError&) {
+                }
+                if (auto fragment = cacheable ? cache.find(key) : nullptr) {
+                    out.write(fragment->data(), fragment->size());
+                    continue;
+                }
+                parser.rewind(start);
+            }
+
+            auto stmt = parser.next_statement();
+            if (options.opt_level > 0) {
+                stmt = folder.fold(stmt);
+            }
+            if (options.backend == Backend::Reg) {
+                reg_generator.generate_stmt(*stmt);
+            } else {
+                stack_generator.generate_stmt(*stmt);
+            }
+            if (cacheable) {
+                fragment.clear();
+                flush(fragment);
+                cache.insert(key, fragment.str());
+                out.write(fragment.str().data(), fragment.str().size());
+            } else {
+                flush(out);
+            }
+        }
+        generate_epilogue(code);
+        flush(out);
+        HOKACC_TRACE(Codegen, "generated {} instructions", instr_count);
+
+        if (peephole && options.peephole_stats) {
+            report_peephole(optimizer.stats, instr_count);
+        }
+    }
+
+private:
+    bool incremental;
+    Parser parser = Parser::streaming({});
+    InstrList code;
+    PeepholeOptions peephole_options;
+    PeepholeOptimizer optimizer{peephole_options};
+    ConstantFolder folder{parser.nodes};
+    StackGenerator stack_generator{code};
+    RegGenerator reg_generator{code};
+    StatementCache cache;
+    std::string key;
+    AsmWriter fragment = AsmWriter::to_memory();
+};
+
+
+inline void compile_streaming(std::string_view source, const CompileOptions& options, AsmWriter& out) {
+    StreamingCompiler().compile(source, options, out);
+}
+
+}
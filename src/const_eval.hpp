@@ -0,0 +1,338 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <string_view>
+#include <vector>
+
+#include <fmt/format.h>
+
+#include "error.hpp"
+#include "parser.hpp"
+#include "token.hpp"
+#include "walk.hpp"
+
+namespace yhok::hokacc {
+
+// プログラムをコンパイルせずに評価した結果。エラーも例外ではなく値で返すので、定数式の中で使える
+struct ConstantResult {
+    bool ok = false;
+    std::int64_t value = 0;
+    std::size_t loc = 0;  // エラーの位置と長さ
+    std::size_t length = 1;
+    std::string_view message;
+};
+
+
+// 制御構造も入力もないプログラムの値は、生成したコードを動かさなくても決まる。
+// コンパイラと同じscan_tokenとparse_exprで文を1つずつ木にし、コード生成器と同じ順に評価して、mainが返すはずの値を求める
+// (a > b は b < a として作るので、右辺から評価される)。
+// 全てconstexprなので、C++の定数式の中で評価すればプログラムの値がビルド時に決まる。
+// エラーは例外にせず値として覚え、それ以降はトークンをEOFにして解析を終わらせる。
+// 実行時に例外になるもの (ゼロ除算と、INT64_MINを-1で割ること) と、初期化していない変数を読むこともエラーにする
+struct ConstantEvaluator {
+    constexpr explicit ConstantEvaluator(std::string_view source) : source(source), cursor(source.data()) {}
+
+    constexpr ConstantResult run() {
+        advance();
+        bool live = true;  // 最初のreturnより後ろも構文は確かめるが、実行はしない
+        bool has_value = false;
+        std::int64_t last = 0;
+        while (token.kind != TokenKind::EndOfFile) {
+            nodes.clear();
+            bool is_return = consume(TokenKind::Return);
+            auto root = parse_expr(*this, pending);
+            expect(TokenKind::SemiColon);
+            if (failed || !live) {
+                continue;
+            }
+            last = evaluate(root);
+            has_value = true;
+            live = !is_return;
+        }
+        if (failed) {
+            return result;
+        }
+        // 文がなければ0を返す
+        result.ok = true;
+        result.value = has_value ? last : 0;
+        return result;
+    }
+
+    // parse_exprのbuilder。ノードはnodesの添字で、whereはエラーを示す演算子の位置
+    using Value = std::size_t;
+
+    struct Where {
+        std::size_t offset = 0;
+        std::size_t length = 1;
+    };
+
+    constexpr TokenKind peek() const {
+        return token.kind;
+    }
+
+    constexpr bool consume(TokenKind kind) {
+        if (token.kind != kind) {
+            return false;
+        }
+        advance();
+        return true;
+    }
+
+    constexpr void expect(TokenKind kind) {
+        if (token.kind != kind) {
+            error(token.offset, token.length, kind == TokenKind::RParen ? "Expected )" : "Expected ;");
+            return;
+        }
+        advance();
+    }
+
+    constexpr Where where() const {
+        return {token.offset, token.length};
+    }
+
+    constexpr Value primary() {
+        auto at = token;
+        if (consume(TokenKind::Number)) {
+            return new_node(NodeKind::Num, at.value, 0, 0, {at.offset, at.length});
+        }
+        if (consume(TokenKind::Identifier)) {
+            return new_node(NodeKind::LVar, at.value, 0, 0, {at.offset, at.length});
+        }
+        error(at.offset, at.length, "Expected number");
+        return 0;
+    }
+
+    constexpr Value neg(Value operand, Where at) {
+        return new_node(NodeKind::Neg, 0, operand, 0, at);
+    }
+
+    constexpr Value binary(const BinaryOperator& op, Value lhs, Value rhs, Where at) {
+        if (failed) {
+            return 0;
+        }
+        if (op.kind == NodeKind::Assign && nodes[lhs].kind != NodeKind::LVar) {
+            error(at.offset, at.length, "Expected LVar");
+            return 0;
+        }
+        return op.swap ? new_node(op.kind, 0, rhs, lhs, at) : new_node(op.kind, 0, lhs, rhs, at);
+    }
+
+    // scan_tokenのsink。識別子はここで変数の番号にする
+    constexpr void push(TokenKind kind, std::size_t loc, std::size_t length) {
+        token = {kind, loc, length, 0};
+    }
+
+    constexpr void push_number(std::size_t loc, std::size_t length, int value) {
+        token = {TokenKind::Number, loc, length, value};
+    }
+
+    constexpr void push_identifier(std::size_t loc, std::size_t length, std::string_view name) {
+        token = {TokenKind::Identifier, loc, length, static_cast<std::int64_t>(lookup(name))};
+    }
+
+    constexpr void error(std::size_t offset, std::size_t length, std::string_view message) {
+        if (failed) {
+            return;
+        }
+        failed = true;
+        result.loc = offset;
+        result.length = length > 0 ? length : 1;
+        result.message = message;
+        token = {TokenKind::EndOfFile, offset, 1, 0};
+    }
+
+private:
+    struct Token {
+        TokenKind kind = TokenKind::EndOfFile;
+        std::size_t offset = 0;
+        std::size_t length = 1;
+        std::int64_t value = 0;  // Numberの値、Identifierの変数の番号
+    };
+
+    struct Node {
+        NodeKind kind = NodeKind::Num;
+        std::int64_t value = 0;  // Numの値、LVarの変数の番号
+        std::size_t lhs = 0;
+        std::size_t rhs = 0;
+        Where where;
+        std::int64_t result = 0;  // 評価した値
+    };
+
+    struct Variable {
+        std::string_view name;
+        std::int64_t value = 0;
+        bool initialized = false;
+    };
+
+    std::string_view source;
+    const char* cursor;
+    Token token;
+    bool failed = false;
+    ConstantResult result;
+
+    // 文をまたいで使い回す
+    std::vector<Node> nodes;
+    std::vector<PendingOperator<Value, Where>> pending;
+    PostOrderWalk<Node*> walk;
+    std::vector<Variable> variables;
+
+    constexpr void advance() {
+        if (!failed) {
+            scan_token(cursor, source, *this);
+        }
+    }
+
+    constexpr Value new_node(NodeKind kind, std::int64_t value, Value lhs, Value rhs, Where at) {
+        if (failed) {
+            return 0;
+        }
+        nodes.push_back({kind, value, lhs, rhs, at});
+        return nodes.size() - 1;
+    }
+
+    // コード生成器と同じく、左の子から評価する。代入の左辺は読まないので、右辺だけを辿る
+    constexpr std::int64_t evaluate(Value root) {
+        walk.run(&nodes[root], [this](Node* node) { return start(*node); },
+                 [this](Node* node) { finish(*node); });
+        return failed ? 0 : nodes[root].result;
+    }
+
+    constexpr Node* start(Node& node) {
+        if (failed) {
+            return nullptr;
+        }
+        switch (node.kind) {
+        case NodeKind::Num:
+            node.result = node.value;
+            return nullptr;
+        case NodeKind::LVar: {
+            const auto& var = variables[static_cast<std::size_t>(node.value)];
+            if (!var.initialized) {
+                error(node.where.offset, node.where.length, "Uninitialized variable");
+                return nullptr;
+            }
+            node.result = var.value;
+            return nullptr;
+        }
+        case NodeKind::Neg:
+            walk.push(&node, true);
+            return &nodes[node.lhs];
+        case NodeKind::Assign:
+            walk.push(&node, true);
+            return &nodes[node.rhs];
+        default:
+            walk.push(&node, true);
+            walk.push(&nodes[node.rhs], false);
+            return &nodes[node.lhs];
+        }
+    }
+
+    // 子を評価し終えたノードの値
+    constexpr void finish(Node& node) {
+        if (failed) {
+            return;
+        }
+        if (node.kind == NodeKind::Assign) {
+            auto& var = variables[static_cast<std::size_t>(nodes[node.lhs].value)];
+            var.value = nodes[node.rhs].result;
+            var.initialized = true;
+            node.result = var.value;
+            return;
+        }
+        if (node.kind == NodeKind::Neg) {
+            node.result = wrap(0 - static_cast<std::uint64_t>(nodes[node.lhs].result));
+            return;
+        }
+
+        auto lhs = nodes[node.lhs].result;
+        auto rhs = nodes[node.rhs].result;
+        auto l = static_cast<std::uint64_t>(lhs);
+        auto r = static_cast<std::uint64_t>(rhs);
+        switch (node.kind) {
+        case NodeKind::Add: node.result = wrap(l + r); break;
+        case NodeKind::Sub: node.result = wrap(l - r); break;
+        case NodeKind::Mul: node.result = wrap(l * r); break;
+        case NodeKind::Div:
+            if (rhs == 0) {
+                error(node.where.offset, node.where.length, "Division by zero");
+                return;
+            }
+            if (lhs == std::numeric_limits<std::int64_t>::min() && rhs == -1) {
+                error(node.where.offset, node.where.length, "Division overflow");
+                return;
+            }
+            node.result = lhs / rhs;
+            break;
+        case NodeKind::Equal: node.result = lhs == rhs; break;
+        case NodeKind::NotEqual: node.result = lhs != rhs; break;
+        case NodeKind::Less: node.result = lhs < rhs; break;
+        case NodeKind::LessEqual: node.result = lhs <= rhs; break;
+        default: break;
+        }
+    }
+
+    // 名前の変数の番号。初めてなら追加する
+    constexpr std::size_t lookup(std::string_view name) {
+        for (std::size_t i = 0; i < variables.size(); ++i) {
+            if (variables[i].name == name) {
+                return i;
+            }
+        }
+        variables.push_back({name});
+        return variables.size() - 1;
+    }
+
+    // 2の補数で折り返す。符号なしから符号付きへの範囲外の変換を避ける
+    static constexpr std::int64_t wrap(std::uint64_t x) {
+        if (x <= static_cast<std::uint64_t>(std::numeric_limits<std::int64_t>::max())) {
+            return static_cast<std::int64_t>(x);
+        }
+        return -static_cast<std::int64_t>(~x) - 1;
+    }
+};
+
+
+constexpr ConstantResult evaluate_constant(std::string_view source) {
+    return ConstantEvaluator(source).run();
+}
+
+// resultの値。エラーなら定数式にならないのでビルドが止まり、実行時ならCompileErrorを投げる
+constexpr std::int64_t value_or_fail(std::string_view source, const ConstantResult& result) {
+    if (!result.ok) {
+        fail_at(source, result.loc, result.length, fmt::format("{}:", result.message), result.message);
+    }
+    return result.value;
+}
+
+// プログラムの値
+constexpr std::int64_t constant_value(std::string_view source) {
+    return value_or_fail(source, evaluate_constant(source));
+}
+
+
+// compileのテンプレート引数に文字列リテラルをそのまま書くための型
+template <std::size_t N>
+struct FixedString {
+    char chars[N]{};
+
+    constexpr FixedString(const char (&s)[N]) {
+        std::copy_n(s, N, chars);
+    }
+
+    constexpr std::string_view view() const {
+        return {chars, N - 1};
+    }
+};
+
+// ビルド時にプログラムを評価した値。compile<"a = 6; a * 7;">() は 42
+template <FixedString source>
+consteval std::int64_t compile() {
+    constexpr auto result = evaluate_constant(source.view());
+    static_assert(result.ok, "the program fails to evaluate");
+    return result.value;
+}
+
+}
@@ -0,0 +1,280 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <fmt/format.h>
+#include <spdlog/spdlog.h>
+
+#include "asm_writer.hpp"
+#include "error.hpp"
+#include "mapped_file.hpp"
+
+namespace yhok::hokacc {
+
+// 内容をそのまま名前にするための128ビットのハッシュ。独立な2本の64ビットの列に8バイトずつ混ぜる。
+// 暗号学的な強さはないが、手元のキャッシュで偶然に衝突しない程度には広い
+struct ContentHasher {
+    // 部分ごとに長さも混ぜるので、区切り方だけが違う入力は別のハッシュになる
+    void update(std::string_view bytes) {
+        const char* p = bytes.data();
+        std::size_t n = bytes.size();
+        for (; n >= 8; p += 8, n -= 8) {
+            std::uint64_t word;
+            std::memcpy(&word, p, sizeof(word));
+            mix(word);
+        }
+        std::uint64_t tail = 0;
+        std::memcpy(&tail, p, n);
+        mix(tail);
+        mix(bytes.size());
+    }
+
+    // 32桁の16進数
+    std::string hex() const {
+        auto high = finalize(a ^ rotl(b, 17));
+        auto low = finalize(b + high);
+        return fmt::format("{:016x}{:016x}", high, low);
+    }
+
+private:
+    std::uint64_t a = 0x243f6a8885a308d3ull;
+    std::uint64_t b = 0x13198a2e03707344ull;
+
+    static std::uint64_t rotl(std::uint64_t x, int r) {
+        return x << r | x >> (64 - r);
+    }
+
+    // 各列の1段はwordについてもその列の値についても全単射なので、1語の違いが消えることはない
+    void mix(std::uint64_t word) {
+        a = rotl(a ^ word * 0x87c37b91114253d5ull, 31) * 0x4cf5ad432745937full;
+        b = rotl(b + (word ^ 0x9e3779b97f4a7c15ull) * 0xff51afd7ed558ccdull, 27) * 0xc4ceb9fe1a85ec53ull;
+    }
+
+    // MurmurHash3の最終段
+    static std::uint64_t finalize(std::uint64_t x) {
+        x ^= x >> 33;
+        x *= 0xff51afd7ed558ccdull;
+        x ^= x >> 33;
+        x *= 0xc4ceb9fe1a85ec53ull;
+        x ^= x >> 33;
+        return x;
+    }
+};
+
+
+// コンパイルの出力を、入力のハッシュを名前にしたファイルとして置いておくディレクトリ。
+// 保存は一時ファイルからのrenameなので、並行に動く他のhokaccが書きかけを読むことはない。
+// 合計がmax_bytesを超えたら、最後に使った時刻 (ヒットのたびに更新するmtime) の古い順に消す。
+// 合計はディレクトリのindexファイルに持ち、プロセスごとにディレクトリを数え直さない
+struct DiskCache {
+    std::atomic<std::size_t> hits = 0;
+    std::atomic<std::size_t> misses = 0;
+    std::atomic<std::size_t> evictions = 0;
+
+    // build_idはキーに混ぜ、別のビルドのhokaccが保存した出力を使わないようにする
+    DiskCache(std::string dir, std::uint64_t max_bytes, std::string_view build_id)
+        : dir(std::move(dir)), max_bytes(max_bytes), build_id(build_id) {
+        std::error_code error;
+        std::filesystem::create_directories(this->dir, error);
+        if (error) {
+            fail("Failed to create {}: {}", this->dir, error.message());
+        }
+    }
+
+    // 出力を変えるオプションをflagsに詰めて、ソースと合わせたキーを作る
+    std::string key(std::string_view flags, std::string_view source) const {
+        ContentHasher hasher;
+        hasher.update(build_id);
+        hasher.update(flags);
+        hasher.update(source);
+        return hasher.hex();
+    }
+
+    // 見つかれば、保存した出力をmmapしてそのままoutに書き、trueを返す。
+    // 読めないエントリ (権限がないなど) はミスとして扱い、コンパイルし直す
+    bool fetch(const std::string& key, AsmWriter& out) {
+        auto path = entry_path(key);
+        auto file = open_entry(path);
+        if (!file) {
+            ++misses;
+            return false;
+        }
+        // 使った時刻を更新して、消される順番を後ろにする
+        ::utimensat(AT_FDCWD, path.c_str(), nullptr, 0);
+        auto output = file->view();
+        out.write_through(output.data(), output.size());
+        ++hits;
+        return true;
+    }
+
+    // 出力を保存する。保存できなくても出力そのものは正しいので、警告だけ出して続ける
+    void store(const std::string& key, std::string_view output) {
+        auto temp = fmt::format("{}/tmp.{}.{}", dir, ::getpid(), temp_count++);
+        try {
+            auto file = AsmWriter::to_file(temp);
+            file.write_through(output.data(), output.size());
+            if (::rename(temp.c_str(), entry_path(key).c_str()) != 0) {
+                fail("Failed to rename {}: {}", temp, std::strerror(errno));
+            }
+        } catch (const CompileError& error) {
+            spdlog::warn("Failed to store the output in the cache: {}", error.what());
+            ::unlink(temp.c_str());
+            return;
+        }
+        account(output.size());
+    }
+
+    void report() const {
+        spdlog::info("cache: {} hits, {} misses, {} evicted", hits.load(), misses.load(), evictions.load());
+    }
+
+private:
+    static constexpr std::size_t key_length = 32;
+
+    std::string dir;
+    std::uint64_t max_bytes;
+    std::string build_id;
+    std::atomic<std::uint64_t> temp_count = 0;
+
+    // 保存した出力の合計の大きさを8バイトで持つファイル。キーの名前でないのでlistには現れない
+    static constexpr const char* index_name = "index";
+    static constexpr std::chrono::hours stale_temp_age{1};
+
+    std::mutex mutex;
+
+    struct Entry {
+        std::string path;
+        std::uint64_t size;
+        std::filesystem::file_time_type used;
+    };
+
+    std::string entry_path(const std::string& key) const {
+        return dir + "/" + key;
+    }
+
+    static std::optional<MappedFile> open_entry(const std::string& path) {
+        try {
+            return MappedFile::open_if_exists(path);
+        } catch (const CompileError& error) {
+            spdlog::warn("Failed to read the cache: {}", error.what());
+            return std::nullopt;
+        }
+    }
+
+    // indexの合計にsizeを足し、max_bytesを超えたら消す。並行に動く他のhokaccとはflockで排他する。
+    // indexがない・壊れているときだけディレクトリを数え直す。同じキーの上書きは二重に数えるが、
+    // 多めに見積もる分には早めにevictが数え直すだけで済む
+    void account(std::uint64_t size) {
+        std::lock_guard lock(mutex);
+        auto index = dir + "/" + index_name;
+        int fd = ::open(index.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            spdlog::warn("Failed to open {}: {}", index, std::strerror(errno));
+        } else {
+            ::flock(fd, LOCK_EX);
+        }
+
+        std::uint64_t total = 0;
+        if (fd >= 0 && ::pread(fd, &total, sizeof(total), 0) == sizeof(total)) {
+            total += size;
+        } else {
+            // 保存したばかりのエントリも数に入る
+            total = 0;
+            for (const auto& entry : list()) {
+                total += entry.size;
+            }
+        }
+        if (total > max_bytes) {
+            total = evict();
+        }
+
+        if (fd >= 0) {
+            if (::pwrite(fd, &total, sizeof(total), 0) != sizeof(total)) {
+                spdlog::warn("Failed to write {}: {}", index, std::strerror(errno));
+            }
+            ::close(fd);
+        }
+    }
+
+    // 古い順に消して、合計をmax_bytesの3/4まで減らし、残った合計を返す。保存のたびに消し始めないよう余裕を残す
+    std::uint64_t evict() {
+        remove_stale_temps();
+        auto entries = list();
+        std::sort(entries.begin(), entries.end(), [](const Entry& x, const Entry& y) {
+            return x.used < y.used;
+        });
+        std::uint64_t sum = 0;
+        for (const auto& entry : entries) {
+            sum += entry.size;
+        }
+        for (const auto& entry : entries) {
+            if (sum <= max_bytes / 4 * 3) {
+                break;
+            }
+            if (::unlink(entry.path.c_str()) == 0) {
+                ++evictions;
+            }
+            sum -= entry.size;
+        }
+        return sum;
+    }
+
+    // renameする前に殺されたプロセスの一時ファイル。listには現れず合計にも数えないので、ここで消さないと溜まり続ける。
+    // 他のプロセスが書いている途中のものを消さないよう、しばらく更新されていないものだけを消す
+    void remove_stale_temps() {
+        auto now = std::filesystem::file_time_type::clock::now();
+        std::error_code error;
+        for (const auto& file : std::filesystem::directory_iterator(dir, error)) {
+            if (file.path().filename().string().rfind("tmp.", 0) != 0) {
+                continue;
+            }
+            std::error_code time_error;
+            auto modified = file.last_write_time(time_error);
+            if (!time_error && now - modified > stale_temp_age) {
+                ::unlink(file.path().c_str());
+            }
+        }
+    }
+
+    // 保存した出力の一覧。一時ファイルなど、キーの名前でないものは含めない
+    std::vector<Entry> list() const {
+        std::vector<Entry> entries;
+        std::error_code error;
+        for (const auto& file : std::filesystem::directory_iterator(dir, error)) {
+            auto name = file.path().filename().string();
+            // isxdigitに負のcharを渡すと未定義なので、unsigned charにしてから調べる
+            auto hex = [](unsigned char c) { return std::isxdigit(c) != 0; };
+            if (name.size() != key_length || !std::all_of(name.begin(), name.end(), hex)) {
+                continue;
+            }
+            std::error_code size_error;
+            std::error_code time_error;
+            auto size = file.file_size(size_error);
+            auto used = file.last_write_time(time_error);
+            if (!size_error && !time_error) {
+                entries.push_back({file.path().string(), size, used});
+            }
+        }
+        return entries;
+    }
+};
+
+}
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <cstddef>
+#include <string_view>
+
+#include "asm_writer.hpp"
+#include "compiler.hpp"
+#include "disk_cache.hpp"
+#include "elf_writer.hpp"
+#include "encoder.hpp"
+#include "error.hpp"
+#include "peephole.hpp"
+#include "stats.hpp"
+
+namespace yhok::hokacc {
+
+enum struct Emit {
+    Asm,  // Intel記法のアセンブリ
+    Obj,  // 機械語を直接エンコードしたELFの再配置可能オブジェクト
+    Jit,  // 出力せずにその場で実行し、結果を表示する
+    Eval,  // コードを生成せず、構文解析しながら評価した値を表示する (const_eval.hpp)
+};
+
+// 出力をファイルやソケットに書くか
+inline bool writes_output(Emit emit) {
+    return emit == Emit::Asm || emit == Emit::Obj;
+}
+
+
+// "none", "all", またはカンマ区切りの規則名
+inline void parse_peephole_rules(std::string_view list, CompileOptions& options) {
+    if (list == "none") {
+        options.peephole = false;
+        return;
+    }
+    options.peephole = true;
+    if (list == "all") {
+        options.peephole_options.enabled.fill(true);
+        return;
+    }
+    options.peephole_options.enabled.fill(false);
+    while (!list.empty()) {
+        auto comma = list.find(',');
+        auto name = list.substr(0, comma);
+        auto rule = find_peephole_rule(name);
+        if (!rule) {
+            fail("Unknown peephole rule: {}", name);
+        }
+        options.peephole_options.enabled[static_cast<std::size_t>(*rule)] = true;
+        list = comma == std::string_view::npos ? std::string_view{} : list.substr(comma + 1);
+    }
+}
+
+
+// コンパイルの仕方を決める引数を1つ解釈する。コマンドラインとコンパイルサーバへの要求で共通。
+// そういう引数でなければfalseを返し、値が不正ならCompileErrorを投げる
+inline bool parse_compile_flag(std::string_view arg, CompileOptions& options, Emit& emit) {
+    if (arg == "-O0" || arg == "-O1") {
+        options.opt_level = arg[2] - '0';
+    } else if (arg == "--backend=stack") {
+        options.backend = Backend::Stack;
+    } else if (arg == "--backend=reg") {
+        options.backend = Backend::Reg;
+    } else if (arg == "--backend=ir") {
+        options.backend = Backend::Ir;
+    } else if (arg == "--emit=asm") {
+        emit = Emit::Asm;
+    } else if (arg == "--emit=obj") {
+        emit = Emit::Obj;
+    } else if (arg == "--jit") {
+        emit = Emit::Jit;
+    } else if (arg == "--eval") {
+        emit = Emit::Eval;
+    } else if (arg == "--time-passes") {
+        options.time_passes = true;
+    } else if (arg.substr(0, 11) == "--peephole=") {
+        parse_peephole_rules(arg.substr(11), options);
+    } else if (arg.substr(0, 18) == "--peephole-window=") {
+        auto value = arg.substr(18);
+        std::size_t window = 0;
+        for (char c : value) {
+            if (c < '0' || c > '9' || window > 1000) {
+                window = 0;
+                break;
+            }
+            window = window * 10 + (c - '0');
+        }
+        if (window < 2) {
+            fail("Invalid peephole window: {}", value);
+        }
+        options.peephole_options.window = window;
+    } else if (arg == "--peephole-stats") {
+        options.peephole_stats = true;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+
+
+// programをコンパイルしてoutに書き出す (--jit以外)。
+// アセンブリは文ごとに生成してすぐ書き出せるので、compilerのバッファを使い回す。
+// statsがあれば、フェーズを分けて測れるように全体をまとめてコンパイルし、書き出しを"emit"として記録する
+inline void compile_to(std::string_view program, const CompileOptions& options, Emit emit, AsmWriter& out,
+                       StreamingCompiler& compiler, CompileStats* stats = nullptr) {
+    if (emit == Emit::Asm && options.backend != Backend::Ir && !stats) {
+        compiler.compile(program, options, out);
+        return;
+    }
+
+    auto code = compile(program, options, stats);
+    PhaseClock clock(stats);
+    if (emit == Emit::Obj) {
+        ElfObject object;
+        object.text = encode(code);
+        object.write(out);
+    } else {
+        emit_asm(code, out);
+    }
+    clock.lap("emit");
+}
+
+
+
+// キャッシュにあればそれを書き、なければコンパイルして出力を保存してから書く。
+// ヒットしたときはハッシュを1回求めてファイルを1つ写すだけで、コンパイラの状態も作らない
+inline void compile_cached(std::string_view program, const CompileOptions& options, Emit emit, AsmWriter& out,
+                           DiskCache& cache) {
+    std::string flags;
+    append_output_options(flags, options);
+    flags += static_cast<char>(emit);
+    auto key = cache.key(flags, program);
+    if (cache.fetch(key, out)) {
+        return;
+    }
+    auto output = AsmWriter::to_memory();
+    StreamingCompiler compiler;
+    compile_to(program, options, emit, output, compiler);
+    cache.store(key, output.str());
+    out.write_through(output.str().data(), output.str().size());
+}
+
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <elf.h>
+
+#include "asm_writer.hpp"
+
+namespace yhok::hokacc {
+
+// 機械語を1つのグローバル関数として持つ再配置可能なELF64オブジェクトを書き出す。
+// 生成コードは外部を参照しないので再配置エントリは要らない
+struct ElfObject {
+    std::vector<std::uint8_t> text;
+    std::string symbol = "main";
+
+    void write(AsmWriter& out) const {
+        enum Section : std::uint16_t { Null, Text, NoteGnuStack, Symtab, Strtab, Shstrtab, Count };
+
+        std::string shstrtab(1, '\0');
+        auto add_name = [](std::string& table, std::string_view name) {
+            auto offset = static_cast<std::uint32_t>(table.size());
+            table.append(name);
+            table.push_back('\0');
+            return offset;
+        };
+        auto text_name = add_name(shstrtab, ".text");
+        auto note_name = add_name(shstrtab, ".note.GNU-stack");
+        auto symtab_name = add_name(shstrtab, ".symtab");
+        auto strtab_name = add_name(shstrtab, ".strtab");
+        auto shstrtab_name = add_name(shstrtab, ".shstrtab");
+
+        std::string strtab(1, '\0');
+        auto symbol_name = add_name(strtab, symbol);
+
+        Elf64_Sym symbols[2] = {};
+        symbols[1].st_name = symbol_name;
+        symbols[1].st_info = ELF64_ST_INFO(STB_GLOBAL, STT_FUNC);
+        symbols[1].st_shndx = Text;
+        symbols[1].st_size = text.size();
+
+        // ヘッダ | .text | .symtab | .strtab | .shstrtab | セクションヘッダ
+        auto align8 = [](std::size_t n) { return (n + 7) / 8 * 8; };
+        std::size_t text_offset = sizeof(Elf64_Ehdr);
+        std::size_t symtab_offset = align8(text_offset + text.size());
+        std::size_t strtab_offset = symtab_offset + sizeof(symbols);
+        std::size_t shstrtab_offset = strtab_offset + strtab.size();
+        std::size_t shdr_offset = align8(shstrtab_offset + shstrtab.size());
+
+        Elf64_Ehdr header = {};
+        std::memcpy(header.e_ident, ELFMAG, SELFMAG);
+        header.e_ident[EI_CLASS] = ELFCLASS64;
+        header.e_ident[EI_DATA] = ELFDATA2LSB;
+        header.e_ident[EI_VERSION] = EV_CURRENT;
+        header.e_ident[EI_OSABI] = ELFOSABI_SYSV;
+        header.e_type = ET_REL;
+        header.e_machine = EM_X86_64;
+        header.e_version = EV_CURRENT;
+        header.e_shoff = shdr_offset;
+        header.e_ehsize = sizeof(Elf64_Ehdr);
+        header.e_shentsize = sizeof(Elf64_Shdr);
+        header.e_shnum = Count;
+        header.e_shstrndx = Shstrtab;
+
+        Elf64_Shdr sections[Count] = {};
+        sections[Text] = {text_name, SHT_PROGBITS, SHF_ALLOC | SHF_EXECINSTR, 0, text_offset, text.size(), 0, 0, 16, 0};
+        sections[NoteGnuStack] = {note_name, SHT_PROGBITS, 0, 0, shdr_offset, 0, 0, 0, 1, 0};
+        // infoは最初のローカルでないシンボルの番号
+        sections[Symtab] = {symtab_name, SHT_SYMTAB, 0, 0, symtab_offset, sizeof(symbols), Strtab, 1, 8, sizeof(Elf64_Sym)};
+        sections[Strtab] = {strtab_name, SHT_STRTAB, 0, 0, strtab_offset, strtab.size(), 0, 0, 1, 0};
+        sections[Shstrtab] = {shstrtab_name, SHT_STRTAB, 0, 0, shstrtab_offset, shstrtab.size(), 0, 0, 1, 0};
+
+        static constexpr char padding[8] = {};
+        out.write(&header, sizeof(header));
+        out.write(text.data(), text.size());
+        out.write(padding, symtab_offset - (text_offset + text.size()));
+        out.write(symbols, sizeof(symbols));
+        out.write(strtab.data(), strtab.size());
+        out.write(shstrtab.data(), shstrtab.size());
+        out.write(padding, shdr_offset - (shstrtab_offset + shstrtab.size()));
+        out.write(sections, sizeof(sections));
+    }
+};
+
+}
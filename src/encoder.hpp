@@ -0,0 +1,320 @@
+#pragma once
+
+#include <cstdint>
+#include <initializer_list>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include "error.hpp"
+#include "instr.hpp"
+
+namespace yhok::hokacc {
+
+// InstrListをx86-64の機械語に直接エンコードする。
+// コード生成器が使う命令と、レジスタ・即値・[reg+index*scale+disp]のオペランドだけを扱う
+struct Encoder {
+    std::vector<std::uint8_t> bytes;
+
+    void encode(const InstrList& code) {
+        bytes.reserve(bytes.size() + code.size() * 4);
+        for (const auto& instr : code.instrs) {
+            encode(instr);
+        }
+    }
+
+    void encode(const Instr& instr) {
+        const auto& dst = instr.dst;
+        const auto& src = instr.src;
+        switch (instr.op) {
+        case Op::Push:
+            if (dst.kind == OperandKind::Reg) {
+                rex_b_only(dst.reg);
+                byte(0x50 + low3(dst.reg));
+            } else if (dst.kind == OperandKind::Imm && fits_int8(dst.value)) {
+                byte(0x6a);
+                byte(static_cast<std::uint8_t>(dst.value));
+            } else if (dst.kind == OperandKind::Imm) {
+                byte(0x68);
+                imm32(checked_imm32(instr, dst.value));
+            } else {
+                rm(false, {0xff}, 6, dst);
+            }
+            return;
+        case Op::Pop:
+            require(instr, dst.kind == OperandKind::Reg);
+            rex_b_only(dst.reg);
+            byte(0x58 + low3(dst.reg));
+            return;
+        case Op::Mov:
+            if (src.kind == OperandKind::Imm) {
+                if (dst.kind == OperandKind::Reg && !fits_int32(src.value)) {
+                    rex(true, 0, dst.reg);
+                    byte(0xb8 + low3(dst.reg));
+                    imm64(src.value);
+                } else {
+                    rm(true, {0xc7}, 0, dst);
+                    imm32(checked_imm32(instr, src.value));
+                }
+            } else if (src.kind == OperandKind::Reg) {
+                rm(true, {0x89}, reg_field(src.reg), dst);
+            } else {
+                require(instr, dst.kind == OperandKind::Reg);
+                rm(true, {0x8b}, reg_field(dst.reg), src);
+            }
+            return;
+        case Op::Movzx:
+            require(instr, dst.kind == OperandKind::Reg);
+            rm(true, {0x0f, 0xb6}, reg_field(dst.reg), src);
+            return;
+        case Op::Lea:
+            require(instr, dst.kind == OperandKind::Reg && src.kind == OperandKind::Mem);
+            rm(true, {0x8d}, reg_field(dst.reg), src);
+            return;
+        case Op::Add:
+            arith(instr, 0x01, 0x03, 0);
+            return;
+        case Op::Sub:
+            arith(instr, 0x29, 0x2b, 5);
+            return;
+        case Op::Cmp:
+            arith(instr, 0x39, 0x3b, 7);
+            return;
+        case Op::Imul:
+            if (src.kind == OperandKind::None) {
+                // rdx:rax = rax * dst
+                rm(true, {0xf7}, 5, dst);
+            } else if (src.kind == OperandKind::Imm) {
+                require(instr, dst.kind == OperandKind::Reg);
+                if (fits_int8(src.value)) {
+                    rm(true, {0x6b}, reg_field(dst.reg), dst);
+                    byte(static_cast<std::uint8_t>(src.value));
+                } else {
+                    rm(true, {0x69}, reg_field(dst.reg), dst);
+                    imm32(checked_imm32(instr, src.value));
+                }
+            } else {
+                require(instr, dst.kind == OperandKind::Reg);
+                rm(true, {0x0f, 0xaf}, reg_field(dst.reg), src);
+            }
+            return;
+        case Op::Cqo:
+            byte(0x48);
+            byte(0x99);
+            return;
+        case Op::Idiv:
+            rm(true, {0xf7}, 7, dst);
+            return;
+        case Op::Neg:
+            rm(true, {0xf7}, 3, dst);
+            return;
+        case Op::Shl:
+            shift(instr, 4);
+            return;
+        case Op::Sar:
+            shift(instr, 7);
+            return;
+        case Op::Shr:
+            shift(instr, 5);
+            return;
+        case Op::Sete:
+            rm(false, {0x0f, 0x94}, 0, dst);
+            return;
+        case Op::Setne:
+            rm(false, {0x0f, 0x95}, 0, dst);
+            return;
+        case Op::Setl:
+            rm(false, {0x0f, 0x9c}, 0, dst);
+            return;
+        case Op::Setle:
+            rm(false, {0x0f, 0x9e}, 0, dst);
+            return;
+        case Op::Setg:
+            rm(false, {0x0f, 0x9f}, 0, dst);
+            return;
+        case Op::Setge:
+            rm(false, {0x0f, 0x9d}, 0, dst);
+            return;
+        case Op::Ret:
+            byte(0xc3);
+            return;
+        default:
+            unsupported(instr);
+        }
+    }
+
+private:
+    static std::uint8_t low3(Register reg) {
+        return static_cast<std::uint8_t>(reg) & 7;
+    }
+
+    static std::uint8_t reg_field(Register reg) {
+        return static_cast<std::uint8_t>(reg);
+    }
+
+    static bool fits_int8(std::int64_t v) {
+        return std::numeric_limits<std::int8_t>::min() <= v && v <= std::numeric_limits<std::int8_t>::max();
+    }
+
+    static bool fits_int32(std::int64_t v) {
+        return std::numeric_limits<std::int32_t>::min() <= v && v <= std::numeric_limits<std::int32_t>::max();
+    }
+
+    [[noreturn]] static void unsupported(const Instr& instr) {
+        fail("Cannot encode instruction: {}", to_string(instr.op));
+    }
+
+    static void require(const Instr& instr, bool ok) {
+        if (!ok) {
+            unsupported(instr);
+        }
+    }
+
+    static std::int32_t checked_imm32(const Instr& instr, std::int64_t v) {
+        require(instr, fits_int32(v));
+        return static_cast<std::int32_t>(v);
+    }
+
+    void byte(std::uint8_t b) {
+        bytes.push_back(b);
+    }
+
+    void imm32(std::int32_t v) {
+        auto u = static_cast<std::uint32_t>(v);
+        for (int i = 0; i < 4; ++i) {
+            byte(static_cast<std::uint8_t>(u >> (8 * i)));
+        }
+    }
+
+    void imm64(std::int64_t v) {
+        auto u = static_cast<std::uint64_t>(v);
+        for (int i = 0; i < 8; ++i) {
+            byte(static_cast<std::uint8_t>(u >> (8 * i)));
+        }
+    }
+
+    // push/popのようにオペコードにレジスタ番号を埋め込む命令のREX
+    void rex_b_only(Register reg) {
+        if (reg_field(reg) >= 8) {
+            byte(0x41);
+        }
+    }
+
+    void rex(bool w, std::uint8_t reg, Register base, bool force = false, bool index = false) {
+        std::uint8_t r = 0x40;
+        if (w) {
+            r |= 0x08;
+        }
+        if (reg >= 8) {
+            r |= 0x04;
+        }
+        if (index) {
+            r |= 0x02;
+        }
+        if (reg_field(base) >= 8) {
+            r |= 0x01;
+        }
+        if (r != 0x40 || force) {
+            byte(r);
+        }
+    }
+
+    // opcode + ModRM (+ SIB) (+ disp) を出力する。regはModRMのregフィールド (レジスタ番号か/digit)
+    void rm(bool w, std::initializer_list<std::uint8_t> opcode, std::uint8_t reg, const Operand& operand) {
+        // spl, bpl, sil, dilはREXがないとah, ch, dh, bhになる
+        bool force = operand.kind == OperandKind::Reg8 && reg_field(operand.reg) >= 4;
+        bool indexed = operand.kind == OperandKind::Mem && operand.scale != 0;
+        rex(w, reg, operand.reg, force, indexed && reg_field(operand.index) >= 8);
+        for (auto b : opcode) {
+            byte(b);
+        }
+
+        auto reg_bits = static_cast<std::uint8_t>((reg & 7) << 3);
+        if (operand.kind == OperandKind::Reg || operand.kind == OperandKind::Reg8) {
+            byte(0xc0 | reg_bits | low3(operand.reg));
+            return;
+        }
+        if (operand.kind != OperandKind::Mem || !fits_int32(operand.value)) {
+            fail("Cannot encode operand of {}", static_cast<int>(operand.kind));
+        }
+
+        auto base = low3(operand.reg);
+        auto disp = operand.value;
+        // [rbp]と[r13]はmod=00だとRIP相対/disp32になるので、disp8=0で表す
+        std::uint8_t mod = disp == 0 && base != 5 ? 0x00 : fits_int8(disp) ? 0x40 : 0x80;
+        if (indexed) {
+            // rm=100でSIBを続ける。rspは添字にできない
+            if (operand.index == Register::Rsp) {
+                fail("Cannot encode rsp as an index");
+            }
+            byte(mod | reg_bits | 4);
+            byte(scale_bits(operand.scale) << 6 | low3(operand.index) << 3 | base);
+        } else {
+            byte(mod | reg_bits | base);
+            // rspとr12をベースにするにはSIBが要る
+            if (base == 4) {
+                byte(0x24);
+            }
+        }
+        if (mod == 0x40) {
+            byte(static_cast<std::uint8_t>(disp));
+        } else if (mod == 0x80) {
+            imm32(static_cast<std::int32_t>(disp));
+        }
+    }
+
+    static std::uint8_t scale_bits(std::uint8_t scale) {
+        switch (scale) {
+        case 1: return 0;
+        case 2: return 1;
+        case 4: return 2;
+        case 8: return 3;
+        default: fail("Cannot encode scale {}", scale);
+        }
+    }
+
+    // シフト幅が1ならGASと同じく短い形にする
+    void shift(const Instr& instr, std::uint8_t digit) {
+        require(instr, instr.src.kind == OperandKind::Imm && 0 <= instr.src.value && instr.src.value < 64);
+        if (instr.src.value == 1) {
+            rm(true, {0xd1}, digit, instr.dst);
+        } else {
+            rm(true, {0xc1}, digit, instr.dst);
+            byte(static_cast<std::uint8_t>(instr.src.value));
+        }
+    }
+
+    // add/sub/cmpの3つの形: r/m, reg  |  reg, r/m  |  r/m, imm
+    void arith(const Instr& instr, std::uint8_t rm_reg, std::uint8_t reg_rm, std::uint8_t digit) {
+        const auto& dst = instr.dst;
+        const auto& src = instr.src;
+        if (src.kind == OperandKind::Imm) {
+            if (fits_int8(src.value)) {
+                rm(true, {0x83}, digit, dst);
+                byte(static_cast<std::uint8_t>(src.value));
+            } else if (dst.is_reg(Register::Rax)) {
+                // raxには短い形があり、GASもそれを選ぶ
+                byte(0x48);
+                byte(static_cast<std::uint8_t>(digit << 3 | 5));
+                imm32(checked_imm32(instr, src.value));
+            } else {
+                rm(true, {0x81}, digit, dst);
+                imm32(checked_imm32(instr, src.value));
+            }
+        } else if (src.kind == OperandKind::Reg) {
+            rm(true, {rm_reg}, reg_field(src.reg), dst);
+        } else {
+            require(instr, dst.kind == OperandKind::Reg);
+            rm(true, {reg_rm}, reg_field(dst.reg), src);
+        }
+    }
+};
+
+
+inline std::vector<std::uint8_t> encode(const InstrList& code) {
+    Encoder encoder;
+    encoder.encode(code);
+    return std::move(encoder.bytes);
+}
+
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include <fmt/format.h>
+#include <spdlog/logger.h>
+
+namespace yhok::hokacc {
+
+// コンパイルを続けられないエラー。what()は改行区切りの複数行になることがある。
+// 捕まえて報告するのはドライバの役目なので、1つの入力の失敗で他の入力のコンパイルは止まらない
+struct CompileError : std::runtime_error {
+    using std::runtime_error::runtime_error;
+};
+
+
+template <typename... Args>
+[[noreturn]] void fail(fmt::format_string<Args...> format, Args&&... args) {
+    throw CompileError(fmt::format(format, std::forward<Args>(args)...));
+}
+
+// sourceのlocからlength文字に印を付けてエラーにする。複数行のソースでは該当する行だけを示す
+[[noreturn]] inline void fail_at(std::string_view source, std::size_t loc, std::size_t length,
+                                 std::string_view headline, std::string_view message) {
+    auto newline = source.substr(0, loc).rfind('\n');
+    std::size_t start = newline == std::string_view::npos ? 0 : newline + 1;
+    auto line = source.substr(start, source.find('\n', loc) - start);
+    if (line.size() == source.size()) {
+        fail("{}\n{}\n{:>{}}^{:~>{}} {}", headline, line, "", loc, "", length - 1, message);
+    }
+    std::size_t line_number = 1;
+    for (std::size_t i = 0; i < start; ++i) {
+        line_number += source[i] == '\n';
+    }
+    fail("line {}: {}\n{}\n{:>{}}^{:~>{}} {}", line_number, headline, line, "", loc - start, "", length - 1, message);
+}
+
+// エラーを1行ずつloggerに出す
+inline void report_error(const CompileError& error, spdlog::logger& logger) {
+    std::string_view rest = error.what();
+    while (!rest.empty()) {
+        auto newline = rest.find('\n');
+        logger.error("{}", rest.substr(0, newline));
+        rest = newline == std::string_view::npos ? std::string_view{} : rest.substr(newline + 1);
+    }
+}
+
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <queue>
+#include <utility>
+#include <vector>
+
+#include "interner.hpp"
+
+namespace yhok::hokacc {
+
+// 変数ごとのスタックフレーム上の置き場所。
+// 制御構造がないので、変数は最初に現れる文から最後に読まれる文まで生きているとみなせる。
+// share_slotsなら、生きている範囲が重ならない変数に同じスロットを使わせ、
+// 最後に読まれる文より後の代入 (デッドストア) には置き場所を与えない
+struct FrameLayout {
+    // 置き場所がないことを表すオフセット
+    static constexpr std::size_t no_slot = 0;
+
+    struct Local {
+        std::uint32_t first = 0;  // 最初に現れる文
+        std::uint32_t last_read = 0;  // 最後に読まれる文 (readのときだけ意味がある)
+        bool seen = false;
+        bool read = false;
+        std::size_t offset = no_slot;
+    };
+
+    std::vector<Local> locals;  // Symbolで引く
+    std::vector<Symbol> order;  // 現れた順
+    std::size_t slot_count = 0;
+    bool share_slots = false;
+
+    void clear() {
+        locals.clear();
+        order.clear();
+        slot_count = 0;
+    }
+
+    // 文statementに変数idが現れたことを記録する。writeなら代入の左辺
+    void record(Symbol id, std::uint32_t statement, bool write) {
+        if (id >= locals.size()) {
+            locals.resize(id + 1);
+        }
+        auto& local = locals[id];
+        if (!local.seen) {
+            local.seen = true;
+            local.first = statement;
+            order.push_back(id);
+        }
+        if (!write) {
+            local.read = true;
+            local.last_read = statement;
+        }
+    }
+
+    // 全ての文を記録した後でスロットを割り当てる
+    void assign(bool share) {
+        share_slots = share;
+        if (!share_slots) {
+            for (auto id : order) {
+                locals[id].offset = ++slot_count * 8;
+            }
+            return;
+        }
+        // 現れた順はfirstの昇順なので、線形走査で終わった範囲のスロットを使い回す。
+        // 同じ文に現れる変数どうしは評価の順によらず別のスロットにする
+        using Range = std::pair<std::uint32_t, std::size_t>;  // (last_read, スロット)
+        std::priority_queue<Range, std::vector<Range>, std::greater<>> active;
+        std::priority_queue<std::size_t, std::vector<std::size_t>, std::greater<>> free;
+        for (auto id : order) {
+            auto& local = locals[id];
+            if (!local.read) {
+                continue;
+            }
+            while (!active.empty() && active.top().first < local.first) {
+                free.push(active.top().second);
+                active.pop();
+            }
+            std::size_t slot;
+            if (free.empty()) {
+                slot = slot_count++;
+            } else {
+                slot = free.top();
+                free.pop();
+            }
+            local.offset = (slot + 1) * 8;
+            active.push({local.last_read, slot});
+        }
+    }
+
+    std::size_t offset(Symbol id) const {
+        return locals[id].offset;
+    }
+
+    // 文statementで変数idに代入するときの置き場所。代入した値が後で読まれないならno_slot
+    std::size_t store_offset(Symbol id, std::uint32_t statement) const {
+        const auto& local = locals[id];
+        if (share_slots && (!local.read || local.last_read < statement)) {
+            return no_slot;
+        }
+        return local.offset;
+    }
+
+    // rbpからrspまでの大きさ。16バイトの倍数にそろえる
+    std::size_t frame_size() const {
+        return (slot_count * 8 + 15) / 16 * 16;
+    }
+};
+
+}
@@ -1,114 +1,413 @@
 #pragma once
 
+#include <cstdint>
+#include <limits>
 #include <string>
 #include <string_view>
-#include <forward_list>
 #include <memory>
+#include <optional>
+#include <vector>
 
 #include <fmt/core.h>
-#include <spdlog/spdlog.h>
 
+#include "error.hpp"
+#include "instr.hpp"
 #include "parser.hpp"
+#include "walk.hpp"
 
 namespace yhok::hokacc {
 
 
-inline void generate_lvar(const Node& node) {
+// 変数がなければフレームは確保しない
+inline void generate_prologue(std::size_t frame_size, InstrList& out) {
+    out.emit(Op::Push, regs::rbp);
+    out.emit(Op::Mov, regs::rbp, regs::rsp);
+    if (frame_size > 0) {
+        out.emit(Op::Sub, regs::rsp, Operand::imm(frame_size));
+    }
+}
+
+
+inline void generate_epilogue(InstrList& out) {
+    out.emit(Op::Mov, regs::rsp, regs::rbp);
+    out.emit(Op::Pop, regs::rbp);
+    out.emit(Op::Ret);
+}
+
+
+inline void generate_lvar(const Node& node, InstrList& out) {
     if (node.kind != NodeKind::LVar) {
-        spdlog::error("Expected LVar, but got {}", to_string(node));
-        std::exit(1);
+        fail("Expected LVar, but got {}", to_string(node));
     }
-    fmt::print("\tmov rax, rbp\n");
-    fmt::print("\tsub rax, {}\n", node.offset);
-    fmt::print("\tpush rax\n");
+    out.emit(Op::Mov, regs::rax, regs::rbp);
+    out.emit(Op::Sub, regs::rax, Operand::imm(node.offset));
+    out.emit(Op::Push, regs::rax);
 }
 
 
-inline void generate(const Node& node) {
+// pushの即値は符号拡張される32ビットまで
+inline bool fits_imm32(std::int64_t val) {
+    return std::numeric_limits<std::int32_t>::min() <= val && val <= std::numeric_limits<std::int32_t>::max();
+}
+
+
+// 比較結果の0/1をraxに入れる
+inline void generate_compare(Op set, InstrList& out) {
+    out.emit(Op::Cmp, regs::rax, regs::rdi);
+    out.emit(set, Operand::reg8(Register::Rax));
+    out.emit(Op::Movzx, regs::rax, Operand::reg8(Register::Rax));
+}
+
+
+// 二項演算の一方が定数なら、それを即値として使える形で返す。
+// otherは値を求める必要のあるもう一方の子で、比較は定数を右辺に回した向きのsetを持つ
+struct ImmediateOperand {
+    const Node* other;
+    std::int64_t value;
+    Op set = Op::Ret;  // 比較のときだけ使う
+};
+
+inline Op compare_op(NodeKind kind, bool swapped) {
+    switch (kind) {
+    case NodeKind::Equal: return Op::Sete;
+    case NodeKind::NotEqual: return Op::Setne;
+    case NodeKind::Less: return swapped ? Op::Setg : Op::Setl;
+    case NodeKind::LessEqual: return swapped ? Op::Setge : Op::Setle;
+    default: return Op::Ret;
+    }
+}
+
+inline std::optional<ImmediateOperand> immediate_operand(const Node& node) {
+    const Node* lhs = node.lhs;
+    const Node* rhs = node.rhs;
     switch (node.kind) {
-    case NodeKind::Return:
-        generate(*node.lhs);
-        fmt::print("\tpop rax\n");
-        fmt::print("\tmov rsp, rbp\n");
-        fmt::print("\tpop rbp\n");
-        fmt::print("\tret\n");
+    case NodeKind::Div:
+        // 0と-1で割るのはidivに任せて、実行時の例外をそのまま起こす
+        if (rhs->kind == NodeKind::Num && rhs->val != 0 && rhs->val != -1) {
+            return ImmediateOperand{lhs, rhs->val};
+        }
+        return std::nullopt;
+    case NodeKind::Sub:
+        if (rhs->kind == NodeKind::Num && fits_imm32(rhs->val)) {
+            return ImmediateOperand{lhs, rhs->val};
+        }
+        return std::nullopt;
+    case NodeKind::Add:
+    case NodeKind::Mul:
+    case NodeKind::Equal:
+    case NodeKind::NotEqual:
+    case NodeKind::Less:
+    case NodeKind::LessEqual:
+        if (rhs->kind == NodeKind::Num && fits_imm32(rhs->val)) {
+            return ImmediateOperand{lhs, rhs->val, compare_op(node.kind, false)};
+        }
+        // 左辺の定数は交換するか、比較の向きを逆にして右辺に回す
+        if (lhs->kind == NodeKind::Num && fits_imm32(lhs->val)) {
+            return ImmediateOperand{rhs, lhs->val, compare_op(node.kind, true)};
+        }
+        return std::nullopt;
+    default:
+        return std::nullopt;
+    }
+}
+
+
+// work = work * value。2の冪はshl、3, 5, 9倍はleaにする
+inline void generate_mul_imm(Operand work, std::int64_t value, InstrList& out) {
+    if (value == 0) {
+        out.emit(Op::Mov, work, Operand::imm(0));
         return;
-    case NodeKind::Num:
-        fmt::print("\tpush {}\n", node.val);
+    }
+    auto magnitude = value < 0 ? 0 - static_cast<std::uint64_t>(value) : static_cast<std::uint64_t>(value);
+    if ((magnitude & (magnitude - 1)) == 0) {
+        int shift = 0;
+        while ((magnitude >> shift) != 1) {
+            ++shift;
+        }
+        if (shift > 0) {
+            out.emit(Op::Shl, work, Operand::imm(shift));
+        }
+    } else if (magnitude == 3 || magnitude == 5 || magnitude == 9) {
+        auto scale = static_cast<std::uint8_t>(magnitude - 1);
+        out.emit(Op::Lea, work, Operand::mem_indexed(work.reg, work.reg, scale));
+    } else {
+        out.emit(Op::Imul, work, Operand::imm(value));
         return;
-    case NodeKind::LVar:
-        generate_lvar(node);
-        fmt::print("\tpop rax\n");
-        fmt::print("\tmov rax, [rax]\n");
-        fmt::print("\tpush rax\n");
+    }
+    if (value < 0) {
+        out.emit(Op::Neg, work);
+    }
+}
+
+
+// 符号付き64ビットの除算を、上位64ビットの積とシフトで置き換えるための定数 (Hacker's Delight 10-1)
+struct DivisionMagic {
+    std::int64_t multiplier;
+    int shift;
+};
+
+// |divisor|は2以上で2の冪でないこと
+inline DivisionMagic division_magic(std::int64_t divisor) {
+    constexpr std::uint64_t two63 = std::uint64_t(1) << 63;
+    auto d = static_cast<std::uint64_t>(divisor);
+    std::uint64_t ad = divisor < 0 ? 0 - d : d;
+    std::uint64_t t = two63 + (d >> 63);
+    std::uint64_t anc = t - 1 - t % ad;
+    int p = 63;
+    std::uint64_t q1 = two63 / anc;
+    std::uint64_t r1 = two63 - q1 * anc;
+    std::uint64_t q2 = two63 / ad;
+    std::uint64_t r2 = two63 - q2 * ad;
+    std::uint64_t delta;
+    do {
+        ++p;
+        q1 *= 2;
+        r1 *= 2;
+        if (r1 >= anc) {
+            ++q1;
+            r1 -= anc;
+        }
+        q2 *= 2;
+        r2 *= 2;
+        if (r2 >= ad) {
+            ++q2;
+            r2 -= ad;
+        }
+        delta = ad - r2;
+    } while (q1 < delta || (q1 == delta && r1 == 0));
+    auto m = q2 + 1;
+    return {static_cast<std::int64_t>(divisor < 0 ? 0 - m : m), p - 64};
+}
+
+// quotient = dividend / divisor をidivを使わずに求める。raxとrdxを壊す。
+// dividendはraxでもrdxでもないこと。divisorは0でも-1でもないこと
+inline void generate_div_imm(Operand quotient, Operand dividend, std::int64_t divisor, InstrList& out) {
+    auto d = static_cast<std::uint64_t>(divisor);
+    std::uint64_t magnitude = divisor < 0 ? 0 - d : d;
+    if (magnitude == 1) {
+        out.emit(Op::Mov, regs::rax, dividend);
+    } else if ((magnitude & (magnitude - 1)) == 0) {
+        // 負の数は切り捨てが0方向になるように2^k - 1を足してから算術シフトする
+        int shift = 0;
+        while ((magnitude >> shift) != 1) {
+            ++shift;
+        }
+        out.emit(Op::Mov, regs::rax, dividend);
+        out.emit(Op::Cqo);
+        out.emit(Op::Shr, regs::rdx, Operand::imm(64 - shift));
+        out.emit(Op::Add, regs::rax, regs::rdx);
+        out.emit(Op::Sar, regs::rax, Operand::imm(shift));
+        if (divisor < 0) {
+            out.emit(Op::Neg, regs::rax);
+        }
+    } else {
+        auto magic = division_magic(divisor);
+        out.emit(Op::Mov, regs::rax, Operand::imm(magic.multiplier));
+        out.emit(Op::Imul, dividend);
+        if (divisor > 0 && magic.multiplier < 0) {
+            out.emit(Op::Add, regs::rdx, dividend);
+        } else if (divisor < 0 && magic.multiplier > 0) {
+            out.emit(Op::Sub, regs::rdx, dividend);
+        }
+        if (magic.shift > 0) {
+            out.emit(Op::Sar, regs::rdx, Operand::imm(magic.shift));
+        }
+        // 負の商は1を足して0方向に丸める
+        out.emit(Op::Mov, regs::rax, regs::rdx);
+        out.emit(Op::Shr, regs::rax, Operand::imm(63));
+        out.emit(Op::Add, regs::rax, regs::rdx);
+    }
+    if (!quotient.is_reg(Register::Rax)) {
+        out.emit(Op::Mov, quotient, regs::rax);
+    }
+}
+
+
+// work = work op value。Divはgenerate_div_immを使う
+inline void generate_immediate_op(NodeKind kind, Operand work, const ImmediateOperand& imm, InstrList& out) {
+    switch (kind) {
+    case NodeKind::Add:
+        out.emit(Op::Add, work, Operand::imm(imm.value));
+        return;
+    case NodeKind::Sub:
+        out.emit(Op::Sub, work, Operand::imm(imm.value));
+        return;
+    case NodeKind::Mul:
+        generate_mul_imm(work, imm.value, out);
         return;
-    case NodeKind::Assign:
-        generate_lvar(*node.lhs);
-        generate(*node.rhs);
-        fmt::print("\tpop rdi\n");
-        fmt::print("\tpop rax\n");
-        fmt::print("\tmov [rax], rdi\n");
-        fmt::print("\tpush rdi\n");
+    case NodeKind::Equal:
+    case NodeKind::NotEqual:
+    case NodeKind::Less:
+    case NodeKind::LessEqual:
+        out.emit(Op::Cmp, work, Operand::imm(imm.value));
+        out.emit(imm.set, Operand::reg8(work.reg));
+        out.emit(Op::Movzx, work, Operand::reg8(work.reg));
         return;
     default:
-        break;
+        fail("Unknown node kind: {}", to_string(kind));
     }
+}
 
-    generate(*node.lhs);
-    generate(*node.rhs);
 
-    fmt::print("\tpop rdi\n");
-    fmt::print("\tpop rax\n");
+// スタックマシンとしてのコード生成器。式の値は全てスタックに積む。
+// 木は明示的なスタックで後行順に辿るので、入れ子の深さによらずネイティブのスタックを使い切らない
+struct StackGenerator {
+    InstrList& out;
+    // 定数のオペランドを積まずに即値で使い、定数の乗除算を軽い命令に置き換える (-O1以上)
+    bool use_immediates = false;
 
-    switch (node.kind) {
+    explicit StackGenerator(InstrList& out) : out(out) {}
 
-    case NodeKind::Add:
-        fmt::print("\tadd rax, rdi\n");
-        break;
+    // 文を生成する。式文の値はraxに残す
+    void generate_stmt(const Node& node) {
+        // 前の文の生成がエラーで中断していたら、積み残しを捨てる
+        walk.clear();
+        if (node.kind == NodeKind::Return) {
+            generate_to_rax(*node.lhs);
+            generate_epilogue(out);
+            return;
+        }
+        generate_to_rax(node);
+    }
 
-    case NodeKind::Sub:
-        fmt::print("\tsub rax, rdi\n");
-        break;
+    // 式の値をスタックに積む
+    void generate(const Node& root) {
+        walk.run(&root, [this](const Node* node) { return start(*node); },
+                 [this](const Node* node) { finish(*node); });
+    }
 
-    case NodeKind::Mul:
-        fmt::print("\timul rax, rdi\n");
-        break;
+private:
+    PostOrderWalk<const Node*> walk;
 
-    case NodeKind::Div:
-        fmt::print("\tcqo\n");
-        fmt::print("\tidiv rdi\n");
-        break;
+    void push(const Node* node, bool visited) {
+        walk.push(node, visited);
+    }
 
-    case NodeKind::Equal:
-        fmt::print("\tcmp rax, rdi\n");
-        fmt::print("\tsete al\n");
-        fmt::print("\tmovzb rax, al\n");
-        break;
+    // 式の値をraxに求める
+    void generate_to_rax(const Node& node) {
+        if (node.kind == NodeKind::Num) {
+            out.emit(Op::Mov, regs::rax, Operand::imm(node.val));
+            return;
+        }
+        generate(node);
+        out.emit(Op::Pop, regs::rax);
+    }
 
-    case NodeKind::NotEqual:
-        fmt::print("\tcmp rax, rdi\n");
-        fmt::print("\tsetne al\n");
-        fmt::print("\tmovzb rax, al\n");
-        break;
+    // 葉ならそのまま生成してnullptrを返す。そうでなければ自分と残りの子を積み、最初に処理する子を返す
+    const Node* start(const Node& node) {
+        switch (node.kind) {
+        case NodeKind::Num:
+            if (fits_imm32(node.val)) {
+                out.emit(Op::Push, Operand::imm(node.val));
+            } else {
+                out.emit(Op::Mov, regs::rax, Operand::imm(node.val));
+                out.emit(Op::Push, regs::rax);
+            }
+            return nullptr;
+        case NodeKind::LVar:
+            generate_lvar(node, out);
+            out.emit(Op::Pop, regs::rax);
+            out.emit(Op::Mov, regs::rax, Operand::mem(Register::Rax));
+            out.emit(Op::Push, regs::rax);
+            return nullptr;
+        case NodeKind::Assign:
+            generate_lvar(*node.lhs, out);
+            push(&node, true);
+            return node.rhs;
+        case NodeKind::Neg:
+            push(&node, true);
+            return node.lhs;
+        case NodeKind::Return:
+            fail("Unexpected return in an expression");
+        default:
+            if (use_immediates) {
+                if (auto imm = immediate_operand(node)) {
+                    push(&node, true);
+                    return imm->other;
+                }
+            }
+            push(&node, true);
+            push(node.rhs, false);
+            return node.lhs;
+        }
+    }
 
-    case NodeKind::Less:
-        fmt::print("\tcmp rax, rdi\n");
-        fmt::print("\tsetl al\n");
-        fmt::print("\tmovzb rax, al\n");
-        break;
+    // 子の値がスタックに積まれた後の処理
+    void finish(const Node& node) {
+        switch (node.kind) {
+        case NodeKind::Assign:
+            out.emit(Op::Pop, regs::rdi);
+            out.emit(Op::Pop, regs::rax);
+            out.emit(Op::Mov, Operand::mem(Register::Rax), regs::rdi);
+            out.emit(Op::Push, regs::rdi);
+            return;
+        case NodeKind::Neg:
+            out.emit(Op::Pop, regs::rax);
+            out.emit(Op::Neg, regs::rax);
+            out.emit(Op::Push, regs::rax);
+            return;
+        default:
+            break;
+        }
 
-    case NodeKind::LessEqual:
-        fmt::print("\tcmp rax, rdi\n");
-        fmt::print("\tsetle al\n");
-        fmt::print("\tmovzb rax, al\n");
-        break;
+        if (use_immediates) {
+            if (auto imm = immediate_operand(node)) {
+                if (node.kind == NodeKind::Div) {
+                    out.emit(Op::Pop, regs::rdi);
+                    generate_div_imm(regs::rax, regs::rdi, imm->value, out);
+                } else {
+                    out.emit(Op::Pop, regs::rax);
+                    generate_immediate_op(node.kind, regs::rax, *imm, out);
+                }
+                out.emit(Op::Push, regs::rax);
+                return;
+            }
+        }
 
-    default:
-        spdlog::error("Unknown node kind: {}", to_string(node));
-        std::exit(1);
+        out.emit(Op::Pop, regs::rdi);
+        out.emit(Op::Pop, regs::rax);
+
+        switch (node.kind) {
+
+        case NodeKind::Add:
+            out.emit(Op::Add, regs::rax, regs::rdi);
+            break;
+
+        case NodeKind::Sub:
+            out.emit(Op::Sub, regs::rax, regs::rdi);
+            break;
+
+        case NodeKind::Mul:
+            out.emit(Op::Imul, regs::rax, regs::rdi);
+            break;
+
+        case NodeKind::Div:
+            out.emit(Op::Cqo);
+            out.emit(Op::Idiv, regs::rdi);
+            break;
+
+        case NodeKind::Equal:
+            generate_compare(Op::Sete, out);
+            break;
+
+        case NodeKind::NotEqual:
+            generate_compare(Op::Setne, out);
+            break;
+
+        case NodeKind::Less:
+            generate_compare(Op::Setl, out);
+            break;
+
+        case NodeKind::LessEqual:
+            generate_compare(Op::Setle, out);
+            break;
+
+        default:
+            fail("Unknown node kind: {}", to_string(node));
+        }
+
+        out.emit(Op::Push, regs::rax);
     }
+};
 
-    fmt::print("\tpush rax\n");
 }
-
-}
\ No newline at end of file
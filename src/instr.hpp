@@ -0,0 +1,262 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "asm_writer.hpp"
+
+namespace yhok::hokacc {
+
+// x86-64のレジスタ。値は命令エンコーディング上の番号と一致させている
+enum struct Register : std::uint8_t {
+    Rax, Rcx, Rdx, Rbx, Rsp, Rbp, Rsi, Rdi,
+    R8, R9, R10, R11, R12, R13, R14, R15,
+};
+
+inline std::string_view to_string(Register reg) {
+    static constexpr std::string_view names[] = {
+        "rax", "rcx", "rdx", "rbx", "rsp", "rbp", "rsi", "rdi",
+        "r8", "r9", "r10", "r11", "r12", "r13", "r14", "r15",
+    };
+    return names[static_cast<int>(reg)];
+}
+
+// 下位8ビットの名前
+inline std::string_view to_string_low8(Register reg) {
+    static constexpr std::string_view names[] = {
+        "al", "cl", "dl", "bl", "spl", "bpl", "sil", "dil",
+        "r8b", "r9b", "r10b", "r11b", "r12b", "r13b", "r14b", "r15b",
+    };
+    return names[static_cast<int>(reg)];
+}
+
+
+enum struct OperandKind : std::uint8_t {
+    None,
+    Reg,   // 64ビットレジスタ
+    Reg8,  // 下位8ビット
+    Imm,   // 即値
+    Mem,   // [reg + index * scale + disp] の64ビットのメモリ
+};
+
+struct Operand {
+    OperandKind kind = OperandKind::None;
+    Register reg = Register::Rax;  // Reg, Reg8, Memのベース
+    Register index = Register::Rax;  // Memの添字 (scaleが0なら使わない)
+    std::uint8_t scale = 0;  // 0, 1, 2, 4, 8
+    std::int64_t value = 0;  // Immの値, Memの変位
+
+    static constexpr Operand reg64(Register reg) {
+        return {OperandKind::Reg, reg, Register::Rax, 0, 0};
+    }
+
+    static constexpr Operand reg8(Register reg) {
+        return {OperandKind::Reg8, reg, Register::Rax, 0, 0};
+    }
+
+    static constexpr Operand imm(std::int64_t value) {
+        return {OperandKind::Imm, Register::Rax, Register::Rax, 0, value};
+    }
+
+    static constexpr Operand mem(Register base, std::int64_t disp = 0) {
+        return {OperandKind::Mem, base, Register::Rax, 0, disp};
+    }
+
+    // [base + index * scale]。leaで定数倍を求めるのに使う
+    static constexpr Operand mem_indexed(Register base, Register index, std::uint8_t scale) {
+        return {OperandKind::Mem, base, index, scale, 0};
+    }
+
+    bool is_reg(Register r) const {
+        return kind == OperandKind::Reg && reg == r;
+    }
+
+    // レジスタrを読み書きするオペランドか (メモリのベースも含む)
+    bool uses(Register r) const {
+        return kind != OperandKind::None && kind != OperandKind::Imm && (reg == r || (scale != 0 && index == r));
+    }
+
+    friend bool operator==(const Operand& a, const Operand& b) {
+        return a.kind == b.kind && a.reg == b.reg && a.index == b.index && a.scale == b.scale && a.value == b.value;
+    }
+};
+
+namespace regs {
+inline constexpr Operand rax = Operand::reg64(Register::Rax);
+inline constexpr Operand rdx = Operand::reg64(Register::Rdx);
+inline constexpr Operand rsp = Operand::reg64(Register::Rsp);
+inline constexpr Operand rbp = Operand::reg64(Register::Rbp);
+inline constexpr Operand rdi = Operand::reg64(Register::Rdi);
+}
+
+
+enum struct Op : std::uint8_t {
+    Push,
+    Pop,
+    Mov,
+    Movzx,
+    Lea,
+    Add,
+    Sub,
+    Imul,  // srcがなければrdx:rax = rax * dst、即値ならdst = dst * src
+    Cqo,
+    Idiv,
+    Neg,
+    Shl,
+    Sar,
+    Shr,
+    Cmp,
+    Sete,
+    Setne,
+    Setl,
+    Setle,
+    Setg,
+    Setge,
+    Ret,
+};
+
+inline std::string_view to_string(Op op) {
+    switch (op) {
+    case Op::Push: return "push";
+    case Op::Pop: return "pop";
+    case Op::Mov: return "mov";
+    case Op::Movzx: return "movzx";
+    case Op::Lea: return "lea";
+    case Op::Add: return "add";
+    case Op::Sub: return "sub";
+    case Op::Imul: return "imul";
+    case Op::Cqo: return "cqo";
+    case Op::Idiv: return "idiv";
+    case Op::Neg: return "neg";
+    case Op::Shl: return "shl";
+    case Op::Sar: return "sar";
+    case Op::Shr: return "shr";
+    case Op::Cmp: return "cmp";
+    case Op::Sete: return "sete";
+    case Op::Setne: return "setne";
+    case Op::Setl: return "setl";
+    case Op::Setle: return "setle";
+    case Op::Setg: return "setg";
+    case Op::Setge: return "setge";
+    case Op::Ret: return "ret";
+    default: return "unknown";
+    }
+}
+
+
+struct Instr {
+    Op op;
+    Operand dst;
+    Operand src;
+
+    // レジスタrを書き換えるか
+    bool writes(Register r) const {
+        switch (op) {
+        case Op::Cmp:
+        case Op::Push:
+        case Op::Ret:
+            return false;
+        case Op::Cqo:
+            return r == Register::Rdx;
+        case Op::Idiv:
+            return r == Register::Rax || r == Register::Rdx;
+        case Op::Imul:
+            if (src.kind == OperandKind::None) {
+                return r == Register::Rax || r == Register::Rdx;
+            }
+            return dst.reg == r;
+        default:
+            return (dst.kind == OperandKind::Reg || dst.kind == OperandKind::Reg8) && dst.reg == r;
+        }
+    }
+
+    // スタック (rsp) を読み書きするか
+    bool touches_stack() const {
+        return op == Op::Push || op == Op::Pop || op == Op::Ret
+            || dst.uses(Register::Rsp) || src.uses(Register::Rsp);
+    }
+};
+
+
+// コード生成器が命令を積んでいく先
+struct InstrList {
+    std::vector<Instr> instrs;
+
+    void emit(Op op, Operand dst = {}, Operand src = {}) {
+        instrs.push_back(Instr{op, dst, src});
+    }
+
+    std::size_t size() const {
+        return instrs.size();
+    }
+};
+
+
+inline void print_operand(const Operand& operand, bool needs_size, AsmWriter& out) {
+    switch (operand.kind) {
+    case OperandKind::Reg:
+        out.print("{}", to_string(operand.reg));
+        return;
+    case OperandKind::Reg8:
+        out.print("{}", to_string_low8(operand.reg));
+        return;
+    case OperandKind::Imm:
+        out.print("{}", operand.value);
+        return;
+    case OperandKind::Mem:
+        if (needs_size) {
+            out.print("QWORD PTR ");
+        }
+        out.print("[{}", to_string(operand.reg));
+        if (operand.scale != 0) {
+            out.print("+{}*{}", to_string(operand.index), operand.scale);
+        }
+        if (operand.value < 0) {
+            out.print("-{}]", -operand.value);
+        } else if (operand.value > 0) {
+            out.print("+{}]", operand.value);
+        } else {
+            out.print("]");
+        }
+        return;
+    default:
+        return;
+    }
+}
+
+inline void print_instr(const Instr& instr, AsmWriter& out) {
+    out.print("\t{}", to_string(instr.op));
+    // レジスタが相手にいなければメモリの大きさを明示する
+    bool needs_size = instr.dst.kind != OperandKind::Reg && instr.src.kind != OperandKind::Reg;
+    if (instr.dst.kind != OperandKind::None) {
+        out.print(" ");
+        print_operand(instr.dst, needs_size, out);
+    }
+    if (instr.src.kind != OperandKind::None) {
+        out.print(", ");
+        print_operand(instr.src, needs_size, out);
+    }
+    out.print("\n");
+}
+
+inline void emit_asm_header(AsmWriter& out) {
+    out.print(".intel_syntax noprefix\n");
+    out.print(".global main\n");
+    out.print("\n");
+    out.print("main:\n");
+}
+
+inline void emit_asm_instrs(const InstrList& code, AsmWriter& out) {
+    for (const auto& instr : code.instrs) {
+        print_instr(instr, out);
+    }
+}
+
+// mainだけからなるIntel記法のアセンブリを書き出す
+inline void emit_asm(const InstrList& code, AsmWriter& out) {
+    emit_asm_header(out);
+    emit_asm_instrs(code, out);
+}
+
+}
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <string_view>
+#include <vector>
+
+#include "arena.hpp"
+
+namespace yhok::hokacc {
+
+// 識別子の番号。最初に現れた順に0, 1, 2, ... と振るので、配列の添字にそのまま使える
+using Symbol = std::uint32_t;
+
+
+// 識別子をSymbolに対応付ける。表は開番地法 (線形探索) で、
+// 名前は文字列アリーナにコピーして持つのでソースのバッファより長生きできる
+struct Interner {
+    Symbol intern(std::string_view name) {
+        auto hash = hash_name(name);
+        auto mask = slots.size() - 1;
+        for (auto i = hash & mask;; i = (i + 1) & mask) {
+            const auto& slot = slots[i];
+            if (slot.symbol == empty) {
+                return insert(i, hash, name);
+            }
+            if (slot.hash == hash && names[slot.symbol] == name) {
+                return slot.symbol;
+            }
+        }
+    }
+
+    std::string_view name(Symbol symbol) const {
+        return names[symbol];
+    }
+
+    // これまでに登録した識別子の数 (次に振る番号)
+    std::size_t size() const {
+        return names.size();
+    }
+
+    // 全ての識別子を忘れて番号を0から振り直す。表と文字列のメモリは次の入力に再利用する
+    void clear() {
+        std::fill(slots.begin(), slots.end(), Slot{});
+        names.clear();
+        strings.clear();
+    }
+
+private:
+    static constexpr Symbol empty = std::numeric_limits<Symbol>::max();
+    static constexpr std::size_t initial_slots = 64;
+
+    // 比較の前にハッシュで弾けるように、番号と一緒に持っておく
+    struct Slot {
+        std::uint32_t hash = 0;
+        Symbol symbol = empty;
+    };
+
+    std::vector<Slot> slots = std::vector<Slot>(initial_slots);
+    std::vector<std::string_view> names;  // Symbolで引く
+    StringArena strings;
+
+    // 8バイトずつ読んで混ぜる。端数は重なってもよいので、ソースの外を読まない範囲でまとめて読む
+    static std::uint32_t hash_name(std::string_view name) {
+        constexpr std::uint64_t multiplier = 0x9e3779b97f4a7c15ull;
+        const char* p = name.data();
+        std::size_t n = name.size();
+        std::uint64_t hash = n * multiplier;
+        for (; n > 8; p += 8, n -= 8) {
+            hash = (hash ^ load64(p)) * multiplier;
+        }
+        std::uint64_t word;
+        if (n == 8) {
+            word = load64(p);
+        } else if (n >= 4) {
+            word = load32(p) | static_cast<std::uint64_t>(load32(p + n - 4)) << 32;
+        } else {
+            auto byte = [](char c) { return static_cast<std::uint64_t>(static_cast<unsigned char>(c)); };
+            word = byte(p[0]) | byte(p[n / 2]) << 8 | byte(p[n - 1]) << 16;
+        }
+        hash = (hash ^ word) * multiplier;
+        // 積の各ビットはそれより下位の入力ビットにしかよらないので、
+        // 上位を下位へ折り返して全てのビットを混ぜる (MurmurHash3の最終段)
+        hash ^= hash >> 33;
+        hash *= 0xff51afd7ed558ccdull;
+        hash ^= hash >> 33;
+        return static_cast<std::uint32_t>(hash);
+    }
+
+    static std::uint64_t load64(const char* p) {
+        std::uint64_t word;
+        std::memcpy(&word, p, sizeof(word));
+        return word;
+    }
+
+    static std::uint32_t load32(const char* p) {
+        std::uint32_t word;
+        std::memcpy(&word, p, sizeof(word));
+        return word;
+    }
+
+    // 新しい識別子はslots[i]に入れる。負荷率が1/2を超えたら表を広げる
+    [[gnu::noinline]] Symbol insert(std::size_t i, std::uint32_t hash, std::string_view name) {
+        auto symbol = static_cast<Symbol>(names.size());
+        slots[i] = {hash, symbol};
+        names.push_back(strings.copy(name));
+        if (names.size() * 2 > slots.size()) {
+            grow();
+        }
+        return symbol;
+    }
+
+    void grow() {
+        std::vector<Slot> old(slots.size() * 2);
+        old.swap(slots);
+        auto mask = slots.size() - 1;
+        for (const auto& slot : old) {
+            if (slot.symbol == empty) {
+                continue;
+            }
+            auto i = slot.hash & mask;
+            while (slots[i].symbol != empty) {
+                i = (i + 1) & mask;
+            }
+            slots[i] = slot;
+        }
+    }
+};
+
+}
@@ -0,0 +1,269 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include <fmt/core.h>
+#include <spdlog/spdlog.h>
+
+#include "error.hpp"
+#include "parser.hpp"
+#include "trace.hpp"
+#include "walk.hpp"
+
+namespace yhok::hokacc {
+
+// 仮想レジスタの番号。IRでは各仮想レジスタはちょうど1回だけ定義される
+using VReg = std::uint32_t;
+inline constexpr VReg no_vreg = std::numeric_limits<VReg>::max();
+
+
+enum struct IrOp : std::uint8_t {
+    Const,  // dst = imm
+    Load,   // dst = [rbp-imm]
+    Store,  // [rbp-imm] = lhs
+    Add,    // dst = lhs + rhs
+    Sub,
+    Mul,
+    Div,
+    Eq,
+    Ne,
+    Lt,
+    Le,
+    Neg,    // dst = -lhs
+    Ret,    // lhsを返して関数を抜ける
+};
+
+inline std::string_view to_string(IrOp op) {
+    switch (op) {
+    case IrOp::Const: return "const";
+    case IrOp::Load: return "load";
+    case IrOp::Store: return "store";
+    case IrOp::Add: return "add";
+    case IrOp::Sub: return "sub";
+    case IrOp::Mul: return "mul";
+    case IrOp::Div: return "div";
+    case IrOp::Eq: return "eq";
+    case IrOp::Ne: return "ne";
+    case IrOp::Lt: return "lt";
+    case IrOp::Le: return "le";
+    case IrOp::Neg: return "neg";
+    case IrOp::Ret: return "ret";
+    default: return "unknown";
+    }
+}
+
+// 除算はゼロ除算で止まりうるので、結果が使われなくても消せない
+inline bool has_side_effect(IrOp op) {
+    return op == IrOp::Store || op == IrOp::Ret || op == IrOp::Div;
+}
+
+
+// 三番地コードの命令列。命令の各フィールドを別々の配列に持つ
+struct IrFunction {
+    std::vector<IrOp> ops;
+    std::vector<VReg> dsts;
+    std::vector<VReg> lhs;
+    std::vector<VReg> rhs;
+    std::vector<std::int64_t> imms;  // Constの値, Load/Storeのオフセット
+
+    VReg vreg_count = 0;
+    std::size_t locals_size = 0;  // ローカル変数の領域のバイト数
+
+    std::size_t size() const {
+        return ops.size();
+    }
+
+    // 値を作る命令を追加し、その結果の仮想レジスタを返す
+    VReg emit(IrOp op, VReg l = no_vreg, VReg r = no_vreg, std::int64_t imm = 0) {
+        VReg dst = vreg_count++;
+        push(op, dst, l, r, imm);
+        return dst;
+    }
+
+    void emit_store(std::int64_t offset, VReg value) {
+        push(IrOp::Store, no_vreg, value, no_vreg, offset);
+    }
+
+    void emit_ret(VReg value) {
+        push(IrOp::Ret, no_vreg, value, no_vreg, 0);
+    }
+
+    void push(IrOp op, VReg dst, VReg l, VReg r, std::int64_t imm) {
+        ops.push_back(op);
+        dsts.push_back(dst);
+        lhs.push_back(l);
+        rhs.push_back(r);
+        imms.push_back(imm);
+    }
+
+    // keep[i]が真の命令だけを残す
+    void retain(const std::vector<bool>& keep) {
+        std::size_t n = 0;
+        for (std::size_t i = 0; i < size(); ++i) {
+            if (!keep[i]) {
+                continue;
+            }
+            ops[n] = ops[i];
+            dsts[n] = dsts[i];
+            lhs[n] = lhs[i];
+            rhs[n] = rhs[i];
+            imms[n] = imms[i];
+            ++n;
+        }
+        truncate(n);
+    }
+
+    void truncate(std::size_t n) {
+        ops.resize(n);
+        dsts.resize(n);
+        lhs.resize(n);
+        rhs.resize(n);
+        imms.resize(n);
+    }
+};
+
+
+inline std::string to_string(const IrFunction& fn, std::size_t i) {
+    auto op = fn.ops[i];
+    switch (op) {
+    case IrOp::Const:
+        return fmt::format("%{} = const {}", fn.dsts[i], fn.imms[i]);
+    case IrOp::Load:
+        return fmt::format("%{} = load [rbp-{}]", fn.dsts[i], fn.imms[i]);
+    case IrOp::Store:
+        return fmt::format("store [rbp-{}], %{}", fn.imms[i], fn.lhs[i]);
+    case IrOp::Neg:
+        return fmt::format("%{} = neg %{}", fn.dsts[i], fn.lhs[i]);
+    case IrOp::Ret:
+        return fmt::format("ret %{}", fn.lhs[i]);
+    default:
+        return fmt::format("%{} = {} %{}, %{}", fn.dsts[i], to_string(op), fn.lhs[i], fn.rhs[i]);
+    }
+}
+
+inline void dump_ir(std::string_view title, const IrFunction& fn) {
+    if (!HOKACC_TRACING(Opt)) {
+        return;
+    }
+    HOKACC_TRACE(Opt, "{}:", title);
+    for (std::size_t i = 0; i < fn.size(); ++i) {
+        HOKACC_TRACE(Opt, "  {}", to_string(fn, i));
+    }
+}
+
+
+// 構文木を三番地コードに変換する。
+// 木は明示的なスタックで後行順に辿るので、入れ子の深さによらず再帰しない
+struct IrLowering {
+    IrFunction& fn;
+
+    explicit IrLowering(IrFunction& fn) : fn(fn) {}
+
+    // nodeの値を持つ仮想レジスタを返す
+    VReg lower(const Node& root) {
+        walk.run(&root, [this](const Node* node) { return start(*node); },
+                 [this](const Node* node) { finish(*node); });
+        auto value = values.back();
+        values.pop_back();
+        return value;
+    }
+
+private:
+    // 文をまたいで使い回す
+    PostOrderWalk<const Node*> walk;
+    std::vector<VReg> values;  // 変換済みの部分木の値
+
+    void push(const Node* node, bool visited) {
+        walk.push(node, visited);
+    }
+
+    // 葉ならそのまま変換してnullptrを返す。そうでなければ自分と残りの子を積み、最初に変換する子を返す
+    const Node* start(const Node& node) {
+        switch (node.kind) {
+        case NodeKind::Num:
+            values.push_back(fn.emit(IrOp::Const, no_vreg, no_vreg, node.val));
+            return nullptr;
+        case NodeKind::LVar:
+            use_local(node.offset);
+            values.push_back(fn.emit(IrOp::Load, no_vreg, no_vreg, node.offset));
+            return nullptr;
+        case NodeKind::Assign:
+            if (node.lhs->kind != NodeKind::LVar) {
+                fail("Expected LVar, but got {}", to_string(*node.lhs));
+            }
+            push(&node, true);
+            return node.rhs;
+        case NodeKind::Neg:
+        case NodeKind::Return:
+            push(&node, true);
+            return node.lhs;
+        default:
+            push(&node, true);
+            push(node.rhs, false);
+            return node.lhs;
+        }
+    }
+
+    // 子の値がvaluesに積まれた後の処理
+    void finish(const Node& node) {
+        switch (node.kind) {
+        case NodeKind::Assign:
+            use_local(node.lhs->offset);
+            fn.emit_store(node.lhs->offset, values.back());
+            return;
+        case NodeKind::Neg:
+            values.back() = fn.emit(IrOp::Neg, values.back());
+            return;
+        case NodeKind::Return:
+            fn.emit_ret(values.back());
+            return;
+        default: {
+            auto r = values.back();
+            values.pop_back();
+            values.back() = fn.emit(binary_op(node.kind), values.back(), r);
+            return;
+        }
+        }
+    }
+
+    void use_local(std::size_t offset) {
+        fn.locals_size = std::max(fn.locals_size, offset);
+    }
+
+    static IrOp binary_op(NodeKind kind) {
+        switch (kind) {
+        case NodeKind::Add: return IrOp::Add;
+        case NodeKind::Sub: return IrOp::Sub;
+        case NodeKind::Mul: return IrOp::Mul;
+        case NodeKind::Div: return IrOp::Div;
+        case NodeKind::Equal: return IrOp::Eq;
+        case NodeKind::NotEqual: return IrOp::Ne;
+        case NodeKind::Less: return IrOp::Lt;
+        case NodeKind::LessEqual: return IrOp::Le;
+        default:
+            fail("Unknown node kind: {}", to_string(kind));
+        }
+    }
+};
+
+
+// プログラム全体を1つの関数に変換する。最後の文の値を返り値にする
+inline IrFunction lower_to_ir(const std::vector<Node*>& code) {
+    IrFunction fn;
+    IrLowering lowering(fn);
+    VReg last = no_vreg;
+    for (const auto& c : code) {
+        last = lowering.lower(*c);
+    }
+    if (last == no_vreg) {
+        last = fn.emit(IrOp::Const, no_vreg, no_vreg, 0);
+    }
+    fn.emit_ret(last);
+    dump_ir("ir", fn);
+    return fn;
+}
+
+}
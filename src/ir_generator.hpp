@@ -0,0 +1,338 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+
+#include "error.hpp"
+#include "generator.hpp"
+#include "instr.hpp"
+#include "ir.hpp"
+#include "ir_passes.hpp"
+#include "reg_generator.hpp"
+#include "trace.hpp"
+
+namespace yhok::hokacc {
+
+// 定数を即値として使う命令のオペランドを選ぶ。
+// 全ての使用が即値になった定数はレジスタに置く必要がないので、割り当ても生成もしない
+struct ImmediateSelection {
+    enum struct Side : std::uint8_t {
+        None,
+        Lhs,  // lhsを即値にする。二項演算ではrhsと入れ替える
+        Rhs,
+    };
+    std::vector<Side> sides;  // 命令ごと
+    std::vector<std::optional<std::int64_t>> constants;  // 仮想レジスタごとの、Constで定義された値
+    std::vector<bool> elided;  // 仮想レジスタごと
+
+    ImmediateSelection(const IrFunction& fn, bool enabled)
+        : sides(fn.size(), Side::None), constants(fn.vreg_count), elided(fn.vreg_count, false) {
+        if (!enabled) {
+            return;
+        }
+        for (std::size_t i = 0; i < fn.size(); ++i) {
+            if (fn.ops[i] == IrOp::Const) {
+                constants[fn.dsts[i]] = fn.imms[i];
+            }
+        }
+
+        std::vector<bool> used(fn.vreg_count, false);
+        for (std::size_t i = 0; i < fn.size(); ++i) {
+            sides[i] = side(fn, i);
+            if (fn.lhs[i] != no_vreg && sides[i] != Side::Lhs) {
+                used[fn.lhs[i]] = true;
+            }
+            if (fn.rhs[i] != no_vreg && sides[i] != Side::Rhs) {
+                used[fn.rhs[i]] = true;
+            }
+        }
+        for (VReg v = 0; v < fn.vreg_count; ++v) {
+            elided[v] = constants[v] && !used[v];
+        }
+    }
+
+    std::int64_t value(VReg v) const {
+        return *constants[v];
+    }
+
+private:
+    bool is_imm32(VReg v) const {
+        return v != no_vreg && constants[v] && fits_imm32(*constants[v]);
+    }
+
+    // 木のコード生成器のimmediate_operandと同じ規則で選ぶ
+    Side side(const IrFunction& fn, std::size_t i) const {
+        auto l = fn.lhs[i];
+        auto r = fn.rhs[i];
+        switch (fn.ops[i]) {
+        case IrOp::Store:
+        case IrOp::Ret:
+            // movは64ビットの即値も置ける
+            return constants[l] ? Side::Lhs : Side::None;
+        case IrOp::Div:
+            // 0と-1で割るのはidivに任せて、実行時の例外をそのまま起こす
+            if (constants[r] && *constants[r] != 0 && *constants[r] != -1) {
+                return Side::Rhs;
+            }
+            return Side::None;
+        case IrOp::Sub:
+            return is_imm32(r) ? Side::Rhs : Side::None;
+        case IrOp::Add:
+        case IrOp::Mul:
+        case IrOp::Eq:
+        case IrOp::Ne:
+        case IrOp::Lt:
+        case IrOp::Le:
+            if (is_imm32(r)) {
+                return Side::Rhs;
+            }
+            return is_imm32(l) ? Side::Lhs : Side::None;
+        default:
+            return Side::None;
+        }
+    }
+};
+
+
+// 仮想レジスタの置き場所を線形走査で決める。
+// 物理レジスタが足りなければ、生存区間の終わりが最も遠いものをスタックに置く
+struct LinearScan {
+    std::vector<Operand> locations;  // 仮想レジスタごとのレジスタかスタック上の位置
+    std::size_t spill_count = 0;
+
+    // elidedな仮想レジスタには置き場所を割り当てない
+    LinearScan(const IrFunction& fn, const std::vector<LiveInterval>& intervals, const std::vector<bool>& elided)
+        : locations(fn.vreg_count) {
+        std::vector<VReg> active;  // endの昇順
+        std::vector<Register> free(scratch_regs.rbegin(), scratch_regs.rend());
+
+        for (std::size_t i = 0; i < fn.size(); ++i) {
+            VReg v = fn.dsts[i];
+            if (v == no_vreg || elided[v]) {
+                continue;
+            }
+            // この命令で最後に使われる値のレジスタは、結果の格納先に再利用してよい
+            while (!active.empty() && intervals[active.front()].end <= i) {
+                free.push_back(locations[active.front()].reg);
+                active.erase(active.begin());
+            }
+
+            if (!free.empty()) {
+                locations[v] = Operand::reg64(free.back());
+                free.pop_back();
+                insert(active, v, intervals);
+                continue;
+            }
+
+            VReg victim = active.back();
+            if (intervals[victim].end > intervals[v].end) {
+                locations[v] = locations[victim];
+                locations[victim] = spill_slot(fn);
+                active.pop_back();
+                insert(active, v, intervals);
+            } else {
+                locations[v] = spill_slot(fn);
+            }
+        }
+    }
+
+    std::size_t frame_size(const IrFunction& fn) const {
+        auto size = fn.locals_size + spill_count * 8;
+        return (size + 15) / 16 * 16;
+    }
+
+private:
+    Operand spill_slot(const IrFunction& fn) {
+        ++spill_count;
+        return Operand::mem(Register::Rbp, -static_cast<std::int64_t>(fn.locals_size + spill_count * 8));
+    }
+
+    static void insert(std::vector<VReg>& active, VReg v, const std::vector<LiveInterval>& intervals) {
+        auto it = std::upper_bound(active.begin(), active.end(), v, [&](VReg a, VReg b) {
+            return intervals[a].end < intervals[b].end;
+        });
+        active.insert(it, v);
+    }
+};
+
+
+// 三番地コードからx86-64の命令を生成する
+struct IrGenerator {
+    const IrFunction& fn;
+    InstrList& out;
+    ImmediateSelection immediates;
+    LinearScan allocation;
+
+    // use_immediatesなら定数を即値で使い、定数の乗除算を軽い命令に置き換える (-O1以上)
+    IrGenerator(const IrFunction& fn, InstrList& out, bool use_immediates = false)
+        : fn(fn), out(out), immediates(fn, use_immediates),
+          allocation(fn, compute_live_intervals(fn), immediates.elided) {}
+
+    void generate() {
+        HOKACC_TRACE(Codegen, "linear scan: {} vregs, {} spilled", fn.vreg_count, allocation.spill_count);
+        generate_prologue(allocation.frame_size(fn), out);
+        for (std::size_t i = 0; i < fn.size(); ++i) {
+            generate(i);
+        }
+    }
+
+private:
+    Operand loc(VReg v) const {
+        return allocation.locations[v];
+    }
+
+    static Operand local(std::int64_t offset) {
+        return Operand::mem(Register::Rbp, -offset);
+    }
+
+    // メモリ同士のmovはできないので、必要ならraxを経由する
+    void move(Operand dst, Operand src) {
+        if (dst == src) {
+            return;
+        }
+        if (dst.kind == OperandKind::Mem && (src.kind == OperandKind::Mem || !fits_imm32(src.value))) {
+            out.emit(Op::Mov, regs::rax, src);
+            out.emit(Op::Mov, dst, regs::rax);
+            return;
+        }
+        out.emit(Op::Mov, dst, src);
+    }
+
+    // lhsのオペランド。即値にしたならその値
+    Operand lhs_operand(std::size_t i) const {
+        if (immediates.sides[i] == ImmediateSelection::Side::Lhs) {
+            return Operand::imm(immediates.value(fn.lhs[i]));
+        }
+        return loc(fn.lhs[i]);
+    }
+
+    void generate(std::size_t i) {
+        auto op = fn.ops[i];
+        if (immediates.sides[i] != ImmediateSelection::Side::None && op != IrOp::Store && op != IrOp::Ret) {
+            generate_immediate(i);
+            return;
+        }
+        switch (op) {
+        case IrOp::Const:
+            if (!immediates.elided[fn.dsts[i]]) {
+                move(loc(fn.dsts[i]), Operand::imm(fn.imms[i]));
+            }
+            return;
+        case IrOp::Load:
+            move(loc(fn.dsts[i]), local(fn.imms[i]));
+            return;
+        case IrOp::Store:
+            move(local(fn.imms[i]), lhs_operand(i));
+            return;
+        case IrOp::Ret:
+            move(regs::rax, lhs_operand(i));
+            generate_epilogue(out);
+            return;
+        case IrOp::Div:
+            move(regs::rax, loc(fn.lhs[i]));
+            out.emit(Op::Cqo);
+            out.emit(Op::Idiv, loc(fn.rhs[i]));
+            move(loc(fn.dsts[i]), regs::rax);
+            return;
+        default:
+            break;
+        }
+
+        auto dst = loc(fn.dsts[i]);
+        auto lhs = loc(fn.lhs[i]);
+        // 結果の格納先がレジスタならそこで直接計算し、そうでなければraxで計算する
+        auto work = dst.kind == OperandKind::Reg ? dst : regs::rax;
+
+        if (op == IrOp::Neg) {
+            move(work, lhs);
+            out.emit(Op::Neg, work);
+            move(dst, work);
+            return;
+        }
+
+        auto rhs = loc(fn.rhs[i]);
+        if (work == rhs && !(work == lhs)) {
+            if (op == IrOp::Add || op == IrOp::Mul) {
+                std::swap(lhs, rhs);
+            } else {
+                work = regs::rax;
+            }
+        }
+        move(work, lhs);
+        switch (op) {
+        case IrOp::Add:
+            out.emit(Op::Add, work, rhs);
+            break;
+        case IrOp::Sub:
+            out.emit(Op::Sub, work, rhs);
+            break;
+        case IrOp::Mul:
+            out.emit(Op::Imul, work, rhs);
+            break;
+        case IrOp::Eq:
+            compare(Op::Sete, work, rhs);
+            break;
+        case IrOp::Ne:
+            compare(Op::Setne, work, rhs);
+            break;
+        case IrOp::Lt:
+            compare(Op::Setl, work, rhs);
+            break;
+        case IrOp::Le:
+            compare(Op::Setle, work, rhs);
+            break;
+        default:
+            fail("Unknown IR op: {}", to_string(op));
+        }
+        move(dst, work);
+    }
+
+    // 一方のオペランドが即値の二項演算
+    void generate_immediate(std::size_t i) {
+        bool swapped = immediates.sides[i] == ImmediateSelection::Side::Lhs;
+        auto other = loc(swapped ? fn.rhs[i] : fn.lhs[i]);
+        auto value = immediates.value(swapped ? fn.lhs[i] : fn.rhs[i]);
+        auto dst = loc(fn.dsts[i]);
+        if (fn.ops[i] == IrOp::Div) {
+            generate_div_imm(dst, other, value, out);
+            return;
+        }
+        auto kind = node_kind(fn.ops[i]);
+        auto work = dst.kind == OperandKind::Reg ? dst : regs::rax;
+        move(work, other);
+        generate_immediate_op(kind, work, ImmediateOperand{nullptr, value, compare_op(kind, swapped)}, out);
+        move(dst, work);
+    }
+
+    static NodeKind node_kind(IrOp op) {
+        switch (op) {
+        case IrOp::Add: return NodeKind::Add;
+        case IrOp::Sub: return NodeKind::Sub;
+        case IrOp::Mul: return NodeKind::Mul;
+        case IrOp::Eq: return NodeKind::Equal;
+        case IrOp::Ne: return NodeKind::NotEqual;
+        case IrOp::Lt: return NodeKind::Less;
+        case IrOp::Le: return NodeKind::LessEqual;
+        default:
+            fail("Unknown IR op: {}", to_string(op));
+        }
+    }
+
+    void compare(Op set, Operand work, Operand rhs) {
+        out.emit(Op::Cmp, work, rhs);
+        out.emit(set, Operand::reg8(work.reg));
+        out.emit(Op::Movzx, work, Operand::reg8(work.reg));
+    }
+};
+
+
+inline void generate_ir(const IrFunction& fn, InstrList& out, bool use_immediates = false) {
+    IrGenerator generator(fn, out, use_immediates);
+    generator.generate();
+}
+
+}
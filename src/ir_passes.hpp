@@ -0,0 +1,243 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <fmt/format.h>
+#include <spdlog/spdlog.h>
+
+#include "ir.hpp"
+#include "stats.hpp"
+
+namespace yhok::hokacc {
+
+// 仮想レジスタが生きている命令の範囲 [start, end]
+struct LiveInterval {
+    std::size_t start = 0;  // 定義する命令
+    std::size_t end = 0;  // 最後に使う命令 (使われなければstart)
+};
+
+// 直線的なコードなので、定義から最後の使用までを1回の走査で求められる
+inline std::vector<LiveInterval> compute_live_intervals(const IrFunction& fn) {
+    std::vector<LiveInterval> intervals(fn.vreg_count);
+    for (std::size_t i = 0; i < fn.size(); ++i) {
+        if (fn.lhs[i] != no_vreg) {
+            intervals[fn.lhs[i]].end = i;
+        }
+        if (fn.rhs[i] != no_vreg) {
+            intervals[fn.rhs[i]].end = i;
+        }
+        if (fn.dsts[i] != no_vreg) {
+            intervals[fn.dsts[i]] = {i, i};
+        }
+    }
+    return intervals;
+}
+
+
+// 最初のretより後ろは実行されない
+inline void remove_unreachable(IrFunction& fn) {
+    for (std::size_t i = 0; i < fn.size(); ++i) {
+        if (fn.ops[i] == IrOp::Ret) {
+            fn.truncate(i + 1);
+            return;
+        }
+    }
+}
+
+
+// 同じ変数への直前のstore/loadの値が分かっているloadを、その値で置き換える。
+// 置き換えたloadは使われなくなるので、後続のdceで消える
+inline void forward_stores(IrFunction& fn) {
+    std::vector<VReg> rename(fn.vreg_count);
+    for (VReg v = 0; v < fn.vreg_count; ++v) {
+        rename[v] = v;
+    }
+    std::vector<VReg> known(fn.locals_size / 8 + 1, no_vreg);  // オフセット/8ごとの現在の値
+
+    for (std::size_t i = 0; i < fn.size(); ++i) {
+        if (fn.lhs[i] != no_vreg) {
+            fn.lhs[i] = rename[fn.lhs[i]];
+        }
+        if (fn.rhs[i] != no_vreg) {
+            fn.rhs[i] = rename[fn.rhs[i]];
+        }
+        auto slot = fn.imms[i] / 8;
+        if (fn.ops[i] == IrOp::Store) {
+            known[slot] = fn.lhs[i];
+        } else if (fn.ops[i] == IrOp::Load) {
+            if (known[slot] != no_vreg) {
+                rename[fn.dsts[i]] = known[slot];
+            } else {
+                known[slot] = fn.dsts[i];
+            }
+        }
+    }
+}
+
+
+// 局所的な値番号付け。演算と被演算子が同じ命令は同じ値を持つので、
+// 2回目以降の結果を最初の命令の仮想レジスタで置き換えて、その命令を消す。
+// forward_storesの後に使えば、変数を読むloadは値そのものに置き換わっているので、
+// 代入を挟んだ同じ式は被演算子が変わって別の値になる。
+// 定数はレジスタに置き続けるより即値で使い直す方が安いので、命令は残して値で比べる
+struct ValueKey {
+    IrOp op;
+    bool lhs_const;
+    bool rhs_const;
+    std::int64_t lhs;  // 定数ならその値、そうでなければ仮想レジスタ
+    std::int64_t rhs;
+
+    bool operator==(const ValueKey& other) const {
+        return op == other.op && lhs_const == other.lhs_const && rhs_const == other.rhs_const &&
+               lhs == other.lhs && rhs == other.rhs;
+    }
+};
+
+struct ValueKeyHash {
+    std::size_t operator()(const ValueKey& key) const {
+        auto h = static_cast<std::uint64_t>(key.op) | key.lhs_const << 8 | key.rhs_const << 9;
+        h = (h ^ static_cast<std::uint64_t>(key.lhs)) * 0x9e3779b97f4a7c15ull;
+        h = (h ^ static_cast<std::uint64_t>(key.rhs)) * 0xff51afd7ed558ccdull;
+        return static_cast<std::size_t>(h ^ h >> 32);
+    }
+};
+
+// 被演算子を入れ替えても値が変わらない演算
+inline bool is_commutative(IrOp op) {
+    return op == IrOp::Add || op == IrOp::Mul || op == IrOp::Eq || op == IrOp::Ne;
+}
+
+inline void eliminate_common_subexpressions(IrFunction& fn) {
+    std::vector<VReg> rename(fn.vreg_count);
+    for (VReg v = 0; v < fn.vreg_count; ++v) {
+        rename[v] = v;
+    }
+    std::vector<std::optional<std::int64_t>> constants(fn.vreg_count);
+    std::unordered_map<ValueKey, VReg, ValueKeyHash> values;
+    std::vector<bool> keep(fn.size(), true);
+    bool changed = false;
+
+    auto operand = [&](VReg v, bool& is_const, std::int64_t& key) {
+        is_const = v != no_vreg && constants[v].has_value();
+        key = is_const ? *constants[v] : static_cast<std::int64_t>(v);
+    };
+
+    for (std::size_t i = 0; i < fn.size(); ++i) {
+        if (fn.lhs[i] != no_vreg) {
+            fn.lhs[i] = rename[fn.lhs[i]];
+        }
+        if (fn.rhs[i] != no_vreg) {
+            fn.rhs[i] = rename[fn.rhs[i]];
+        }
+        auto op = fn.ops[i];
+        if (op == IrOp::Const) {
+            constants[fn.dsts[i]] = fn.imms[i];
+            continue;
+        }
+        // 同じ変数のloadはforward_storesがまとめる。ゼロ除算で止まる除算も、2回目は最初の除算が通った後なので消せる
+        if (op == IrOp::Load || op == IrOp::Store || op == IrOp::Ret) {
+            continue;
+        }
+        ValueKey key{op, false, false, 0, 0};
+        operand(fn.lhs[i], key.lhs_const, key.lhs);
+        operand(fn.rhs[i], key.rhs_const, key.rhs);
+        if (is_commutative(op) &&
+            std::make_pair(key.lhs_const, key.lhs) > std::make_pair(key.rhs_const, key.rhs)) {
+            std::swap(key.lhs_const, key.rhs_const);
+            std::swap(key.lhs, key.rhs);
+        }
+        auto [it, inserted] = values.try_emplace(key, fn.dsts[i]);
+        if (!inserted) {
+            rename[fn.dsts[i]] = it->second;
+            keep[i] = false;
+            changed = true;
+        }
+    }
+    if (changed) {
+        fn.retain(keep);
+    }
+}
+
+
+// 結果が使われず副作用もない命令を消す
+inline void eliminate_dead_code(IrFunction& fn) {
+    std::vector<bool> used(fn.vreg_count, false);
+    std::vector<bool> keep(fn.size(), false);
+    for (std::size_t i = fn.size(); i-- > 0;) {
+        if (!has_side_effect(fn.ops[i]) && !used[fn.dsts[i]]) {
+            continue;
+        }
+        keep[i] = true;
+        if (fn.lhs[i] != no_vreg) {
+            used[fn.lhs[i]] = true;
+        }
+        if (fn.rhs[i] != no_vreg) {
+            used[fn.rhs[i]] = true;
+        }
+    }
+    fn.retain(keep);
+}
+
+
+struct IrPass {
+    std::string_view name;
+    void (*run)(IrFunction&);
+};
+
+struct PassTiming {
+    std::string_view name;
+    std::chrono::nanoseconds elapsed;
+    std::size_t size_before;
+    std::size_t size_after;
+};
+
+
+// パスを登録順に実行し、パスごとの所要時間と命令数の変化を記録する
+struct PassManager {
+    std::vector<IrPass> passes;
+    std::vector<PassTiming> timings;
+
+    void add(std::string_view name, void (*run)(IrFunction&)) {
+        passes.push_back({name, run});
+    }
+
+    // clockがあれば、パスごとに"pass <名前>"のフェーズとして記録する
+    void run(IrFunction& fn, PhaseClock* clock = nullptr) {
+        for (const auto& pass : passes) {
+            auto before = fn.size();
+            auto start = std::chrono::steady_clock::now();
+            pass.run(fn);
+            auto elapsed = std::chrono::steady_clock::now() - start;
+            timings.push_back({pass.name, elapsed, before, fn.size()});
+            if (clock) {
+                clock->lap(fmt::format("pass {}", pass.name));
+            }
+            dump_ir(pass.name, fn);
+        }
+    }
+
+    void report() const {
+        for (const auto& t : timings) {
+            spdlog::info("pass {}: {} us, {} -> {} instructions",
+                         t.name, t.elapsed.count() / 1000.0, t.size_before, t.size_after);
+        }
+    }
+};
+
+// -O1で使うパスの並び
+inline PassManager default_passes() {
+    PassManager pm;
+    pm.add("unreachable", remove_unreachable);
+    pm.add("forward-stores", forward_stores);
+    pm.add("cse", eliminate_common_subexpressions);
+    pm.add("dce", eliminate_dead_code);
+    return pm;
+}
+
+}
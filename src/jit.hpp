@@ -0,0 +1,79 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "compiler.hpp"
+#include "encoder.hpp"
+#include "error.hpp"
+#include "stats.hpp"
+
+namespace yhok::hokacc {
+
+// 機械語を置いた実行可能なメモリ。書き込み中だけRWにし、実行時はRXにする (W^X)
+struct JitCode {
+    using Entry = long (*)();
+
+    static JitCode load(const std::vector<std::uint8_t>& text) {
+        auto page = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+        auto size = (std::max<std::size_t>(text.size(), 1) + page - 1) / page * page;
+        void* p = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED) {
+            fail("Failed to map JIT memory: {}", std::strerror(errno));
+        }
+        std::memcpy(p, text.data(), text.size());
+        if (::mprotect(p, size, PROT_READ | PROT_EXEC) != 0) {
+            ::munmap(p, size);
+            fail("Failed to make JIT memory executable: {}", std::strerror(errno));
+        }
+        return JitCode(p, size);
+    }
+
+    JitCode(const JitCode&) = delete;
+    JitCode& operator=(const JitCode&) = delete;
+
+    JitCode(JitCode&& other)
+        : memory(std::exchange(other.memory, nullptr)), size(std::exchange(other.size, 0)) {}
+
+    JitCode& operator=(JitCode&&) = delete;
+
+    ~JitCode() {
+        if (memory != nullptr) {
+            ::munmap(memory, size);
+        }
+    }
+
+    Entry entry() const {
+        return reinterpret_cast<Entry>(memory);
+    }
+
+    long run() const {
+        return entry()();
+    }
+
+private:
+    JitCode(void* memory, std::size_t size) : memory(memory), size(size) {}
+
+    void* memory;
+    std::size_t size;
+};
+
+
+// ソースをコンパイルしてそのまま実行し、mainの返り値を返す
+inline long jit_run(std::string_view source, const CompileOptions& options = {}, CompileStats* stats = nullptr) {
+    auto instrs = compile(source, options, stats);
+    PhaseClock clock(stats);
+    auto code = JitCode::load(encode(instrs));
+    clock.lap("emit");
+    return code.run();
+}
+
+}
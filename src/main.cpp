@@ -1,46 +1,296 @@
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
 #include <fmt/core.h>
 #include <spdlog/spdlog.h>
 #include <spdlog/sinks/stdout_color_sinks.h>
 
-#include "token.hpp"
-#include "parser.hpp"
-#include "generator.hpp"
+#include "asm_writer.hpp"
+#include "compiler.hpp"
+#include "const_eval.hpp"
+#include "disk_cache.hpp"
+#include "driver.hpp"
+#include "error.hpp"
+#include "jit.hpp"
+#include "mapped_file.hpp"
+#include "server.hpp"
+#include "stats.hpp"
+#include "thread_pool.hpp"
+#include "trace.hpp"
 
 using namespace yhok::hokacc;
 
 
+// キャッシュのキーに混ぜるビルドの識別子。CMakeがコンパイラのソースのハッシュから作る
+constexpr std::string_view build_id = HOKACC_VERSION " " HOKACC_BUILD_ID;
+
+
+struct Options {
+    std::string output;  // 空なら標準出力。一括コンパイルでは出力先のディレクトリ (空ならカレント)
+    Emit emit = Emit::Asm;
+    CompileOptions compile;
+    std::size_t jobs = 0;  // 1以上なら、inputsをファイル名としてこのスレッド数で一括コンパイルする
+    bool server = false;  // 入力の代わりに要求を受けてコンパイルし続ける
+    std::string socket;  // サーバが待ち受けるUnixドメインソケット。空なら標準入出力でやりとりする
+    std::string cache_dir;  // 空でなければ、出力をこのディレクトリにキャッシュする
+    std::uint64_t cache_size = 256;  // キャッシュの上限 (MiB)
+    bool cache_stats = false;
+    bool stats = false;  // フェーズごとの時間とメモリ、入力の規模を標準エラーに表示する
+    bool stats_json = false;  // その表示をJSONの1行にする
+    std::vector<std::string_view> inputs;  // 一括コンパイルでなければ、プログラムそのものが1つだけ
+};
+
+
+int usage(const char* argv0) {
+    fmt::print("Usage: {} [-o <file>] [-O0|-O1] [--backend=stack|reg|ir] [--emit=asm|obj] [--jit] [--eval] [--time-passes]\n"
+               "       [--trace=lex,parse,opt,codegen|all]\n"
+               "       [--peephole=none|all|<rule>,...] [--peephole-window=<n>] [--peephole-stats]\n"
+               "       [--cache-dir=<dir>] [--cache-size=<MiB>] [--cache-stats] [--stats[=json]] <string>\n"
+               "       {} -j <n> [-o <dir>] [options...] <file>...\n"
+               "       {} --server[=<socket>] [-j <n>] [options...]\n",
+               argv0, argv0, argv0);
+    return 1;
+}
+
+
+// 出力先のディレクトリに、入力と同じ名前で拡張子だけ変えて書き出す
+std::string output_path(std::string_view input, const Options& options) {
+    auto name = std::filesystem::path(input).filename();
+    name.replace_extension(options.emit == Emit::Obj ? ".o" : ".s");
+    return (std::filesystem::path(options.output) / name).string();
+}
+
+
+// cacheがあればキャッシュを引き、なければコンパイルする
+void compile_output(std::string_view program, const Options& options, AsmWriter& out, DiskCache* cache,
+                    CompileStats* stats = nullptr) {
+    if (cache) {
+        compile_cached(program, options.compile, options.emit, out, *cache);
+        return;
+    }
+    StreamingCompiler compiler;
+    compile_to(program, options.compile, options.emit, out, compiler, stats);
+}
+
+
+void report_stats(const CompileStats& stats, const Options& options) {
+    if (options.stats_json) {
+        fmt::print(stderr, "{}\n", stats.json());
+    } else {
+        stats.report();
+    }
+}
+
+
+// 1つのファイルをコンパイルする。エラーはそのファイルの名前を付けたロガーに出し、
+// 書きかけの出力を消してfalseを返す
+bool compile_file(std::string_view input, const Options& options, DiskCache* cache, const spdlog::sink_ptr& sink) {
+    auto output = output_path(input, options);
+    try {
+        auto file = MappedFile::open(std::string(input));
+        auto out = AsmWriter::to_file(output);
+        compile_output(file.view(), options, out, cache);
+        out.flush();
+        return true;
+    } catch (const CompileError& error) {
+        spdlog::logger logger(std::string(input), sink);
+        report_error(error, logger);
+        std::error_code ignored;
+        std::filesystem::remove(output, ignored);
+        return false;
+    }
+}
+
+
+// 入力ファイルをスレッドで分担してコンパイルする。失敗したファイルがあっても残りは続ける
+int compile_batch(const Options& options, DiskCache* cache) {
+    if (!options.output.empty()) {
+        std::error_code error;
+        std::filesystem::create_directories(options.output, error);
+        if (error) {
+            spdlog::error("Failed to create {}: {}", options.output, error.message());
+            return 1;
+        }
+    }
+
+    // 標準エラーへの出力先は全てのジョブで共有し、ロガーはジョブごとに作る
+    auto sink = std::make_shared<spdlog::sinks::stderr_color_sink_mt>();
+    std::vector<char> succeeded(options.inputs.size());
+    WorkStealingPool pool(std::min(options.jobs, options.inputs.size()));
+    pool.run(options.inputs.size(), [&](std::size_t i) {
+        succeeded[i] = compile_file(options.inputs[i], options, cache, sink);
+    });
+
+    auto failed = std::count(succeeded.begin(), succeeded.end(), 0);
+    if (failed > 0) {
+        spdlog::error("{} of {} files failed to compile", failed, options.inputs.size());
+        return 1;
+    }
+    return 0;
+}
+
+
+// 標準入出力か、ソケットで-jのスレッド数 (既定はCPUの数) のワーカーで要求を処理し続ける
+int serve(const Options& options) {
+    try {
+        if (options.socket.empty()) {
+            ServerSession(options.compile, options.emit).serve(STDIN_FILENO, STDOUT_FILENO);
+            return 0;
+        }
+        auto workers = options.jobs > 0 ? options.jobs : std::max(std::thread::hardware_concurrency(), 1u);
+        CompileServer server(options.socket, workers, options.compile, options.emit);
+        spdlog::info("Listening on {} with {} workers", options.socket, workers);
+        server.wait();
+    } catch (const CompileError& error) {
+        spdlog::error("{}", error.what());
+        return 1;
+    }
+    return 0;
+}
+
+
 int main(int argc, char* argv[]) {
     auto err_logger = spdlog::stderr_color_mt("stderr");
     spdlog::set_default_logger(err_logger);
-    spdlog::set_level(spdlog::level::debug);
 
-    if (argc < 2) {
-        fmt::print("Usage: {} <string>\n", argv[0]);
-        return 1;
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        std::string_view arg = argv[i];
+        if (arg == "-o") {
+            if (i + 1 >= argc) {
+                return usage(argv[0]);
+            }
+            options.output = argv[++i];
+        } else if (arg == "-j" || (arg.substr(0, 2) == "-j" && std::isdigit(static_cast<unsigned char>(arg[2])))) {
+            // -j <n> と -j<n> のどちらでもよい
+            const char* count = arg.size() > 2 ? argv[i] + 2 : i + 1 < argc ? argv[++i] : "";
+            auto jobs = std::atoi(count);
+            if (jobs < 1) {
+                return usage(argv[0]);
+            }
+            options.jobs = jobs;
+        } else if (arg.substr(0, 8) == "--trace=") {
+            if (!HOKACC_ENABLE_TRACE) {
+                spdlog::warn("Tracing is disabled in this build");
+            } else if (!trace::enable(arg.substr(8))) {
+                return usage(argv[0]);
+            }
+        } else if (arg.substr(0, 12) == "--cache-dir=") {
+            options.cache_dir = arg.substr(12);
+        } else if (arg.substr(0, 13) == "--cache-size=") {
+            auto size = std::atoll(argv[i] + 13);
+            if (size < 1) {
+                return usage(argv[0]);
+            }
+            options.cache_size = size;
+        } else if (arg == "--cache-stats") {
+            options.cache_stats = true;
+        } else if (arg == "--stats" || arg == "--stats=text") {
+            options.stats = true;
+        } else if (arg == "--stats=json") {
+            options.stats = true;
+            options.stats_json = true;
+        } else if (arg == "--server") {
+            options.server = true;
+        } else if (arg.substr(0, 9) == "--server=") {
+            options.server = true;
+            options.socket = arg.substr(9);
+        } else {
+            try {
+                if (!parse_compile_flag(arg, options.compile, options.emit)) {
+                    options.inputs.push_back(arg);
+                }
+            } catch (const CompileError& error) {
+                report_error(error, *err_logger);
+                return usage(argv[0]);
+            }
+        }
+    }
+    if (options.server) {
+        if (!options.inputs.empty() || !writes_output(options.emit) || options.stats) {
+            return usage(argv[0]);
+        }
+        return serve(options);
     }
-    auto tokens = tokenize(argv[1]);
-    Parser parser(*tokens, argv[1]);
+    // 統計は1つの入力のコンパイルについてだけ取る
+    if (options.jobs > 0 ? options.inputs.empty() || !writes_output(options.emit) || options.stats
+                         : options.inputs.size() != 1) {
+        return usage(argv[0]);
+    }
+    // トレースはdebugレベルで出力する
+    spdlog::set_level(trace::enabled_categories != 0 ? spdlog::level::debug : spdlog::level::info);
 
-    fmt::print(".intel_syntax noprefix\n");
-    fmt::print(".global main\n");
-    fmt::print("\n");
-    fmt::print("main:\n");
+    // 統計やトレースはコンパイルしないと出せないので、そのときはキャッシュを使わない
+    std::optional<DiskCache> cache;
+    bool must_compile = options.compile.time_passes || options.compile.peephole_stats || options.stats ||
+                        trace::enabled_categories != 0;
+    if (!options.cache_dir.empty() && writes_output(options.emit) && !must_compile) {
+        try {
+            cache.emplace(options.cache_dir, options.cache_size << 20, build_id);
+        } catch (const CompileError& error) {
+            report_error(error, *err_logger);
+            return 1;
+        }
+    }
+    auto report_cache = [&] {
+        if (cache && options.cache_stats) {
+            cache->report();
+        }
+    };
 
-    // Prologue
-    fmt::print("\tpush rbp\n");
-    fmt::print("\tmov rbp, rsp\n");
-    fmt::print("\tsub rsp, {}\n", 8 * 26);
+    if (options.jobs > 0) {
+        auto status = compile_batch(options, cache ? &*cache : nullptr);
+        report_cache();
+        return status;
+    }
 
-    // Generate code
-    for (const auto& c : parser.code) {
-        generate(*c);
-        fmt::print("\tpop rax\n");
+    std::optional<CompileStats> stats;
+    if (options.stats) {
+        stats.emplace();
     }
+    bool opened_output = false;
+    try {
+        // 結果を標準出力に表示し、実行ファイルと同じく終了コードとしても返す
+        if (options.emit == Emit::Eval) {
+            auto result = constant_value(options.inputs[0]);
+            fmt::print("{}\n", result);
+            return static_cast<int>(result & 0xff);
+        }
+        if (options.emit == Emit::Jit) {
+            auto result = jit_run(options.inputs[0], options.compile, stats ? &*stats : nullptr);
+            if (stats) {
+                report_stats(*stats, options);
+            }
+            fmt::print("{}\n", result);
+            return static_cast<int>(result & 0xff);
+        }
 
-    // Epilogue
-    fmt::print("\tmov rsp, rbp\n");
-    fmt::print("\tpop rbp\n");
-    fmt::print("\tret\n");
+        auto out = options.output.empty() ? AsmWriter::to_stdout() : AsmWriter::to_file(options.output);
+        opened_output = !options.output.empty();
+        compile_output(options.inputs[0], options, out, cache ? &*cache : nullptr, stats ? &*stats : nullptr);
+        out.flush();
+        if (stats) {
+            report_stats(*stats, options);
+        }
+    } catch (const CompileError& error) {
+        report_error(error, *err_logger);
+        // 書きかけの出力が残ると、makeなどが最新の出力とみなしてしまう。outは既に閉じている
+        if (opened_output) {
+            std::error_code ignored;
+            std::filesystem::remove(options.output, ignored);
+        }
+        return 1;
+    }
+    report_cache();
 
     return 0;
 }
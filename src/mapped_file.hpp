@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cerrno>
+#include <cstring>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "error.hpp"
+
+namespace yhok::hokacc {
+
+// 読み取り専用でmmapした入力ファイル。view()はマッピングを直接指すのでコピーしない
+struct MappedFile {
+    static MappedFile open(const std::string& path) {
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            fail("Failed to open {}: {}", path, std::strerror(errno));
+        }
+        return map(fd, path);
+    }
+
+    // ファイルがなければnullopt。その他の失敗はopenと同じくCompileErrorにする
+    static std::optional<MappedFile> open_if_exists(const std::string& path) {
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            if (errno == ENOENT) {
+                return std::nullopt;
+            }
+            fail("Failed to open {}: {}", path, std::strerror(errno));
+        }
+        return map(fd, path);
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    MappedFile(MappedFile&& other)
+        : data(std::exchange(other.data, nullptr)), size(std::exchange(other.size, 0)) {}
+
+    MappedFile& operator=(MappedFile&&) = delete;
+
+    ~MappedFile() {
+        if (data) {
+            ::munmap(const_cast<char*>(data), size);
+        }
+    }
+
+    std::string_view view() const {
+        return std::string_view(data, size);
+    }
+
+private:
+    MappedFile() = default;
+
+    // fdをmmapしてから閉じる
+    static MappedFile map(int fd, const std::string& path) {
+        struct stat st;
+        if (::fstat(fd, &st) != 0) {
+            auto error = errno;
+            ::close(fd);
+            fail("Failed to stat {}: {}", path, std::strerror(error));
+        }
+        MappedFile file;
+        file.size = static_cast<std::size_t>(st.st_size);
+        // 長さ0はmmapできないので空のビューのままにする
+        if (file.size > 0) {
+            void* p = ::mmap(nullptr, file.size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p == MAP_FAILED) {
+                auto error = errno;
+                ::close(fd);
+                fail("Failed to map {}: {}", path, std::strerror(error));
+            }
+            file.data = static_cast<const char*>(p);
+        }
+        // マッピングはファイルを閉じても残る
+        ::close(fd);
+        return file;
+    }
+
+    const char* data = nullptr;
+    std::size_t size = 0;
+};
+
+}
@@ -0,0 +1,247 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+
+#include "parser.hpp"
+#include "trace.hpp"
+#include "walk.hpp"
+
+namespace yhok::hokacc {
+
+// 生成されるコードと同じ64ビットの意味で二項演算を評価する。
+// 実行時にidivが例外を起こす場合は畳み込まない
+inline std::optional<std::int64_t> evaluate(NodeKind kind, std::int64_t lhs, std::int64_t rhs) {
+    auto ul = static_cast<std::uint64_t>(lhs);
+    auto ur = static_cast<std::uint64_t>(rhs);
+    switch (kind) {
+    case NodeKind::Add: return static_cast<std::int64_t>(ul + ur);
+    case NodeKind::Sub: return static_cast<std::int64_t>(ul - ur);
+    case NodeKind::Mul: return static_cast<std::int64_t>(ul * ur);
+    case NodeKind::Div:
+        if (rhs == 0 || (lhs == std::numeric_limits<std::int64_t>::min() && rhs == -1)) {
+            return std::nullopt;
+        }
+        return lhs / rhs;
+    case NodeKind::Equal: return lhs == rhs;
+    case NodeKind::NotEqual: return lhs != rhs;
+    case NodeKind::Less: return lhs < rhs;
+    case NodeKind::LessEqual: return lhs <= rhs;
+    default: return std::nullopt;
+    }
+}
+
+
+inline bool is_number(const Node* node, std::int64_t val) {
+    return node->kind == NodeKind::Num && node->val == val;
+}
+
+
+// 畳み込み済みの式の符号を反転する
+inline Node* negate(Node* operand, NodeArena& arena) {
+    if (operand->kind == NodeKind::Num) {
+        return Node::new_number(arena, static_cast<std::int64_t>(0 - static_cast<std::uint64_t>(operand->val)));
+    }
+    if (operand->kind == NodeKind::Neg) {
+        return operand->lhs;
+    }
+    return Node::new_unary_op(arena, NodeKind::Neg, operand);
+}
+
+
+// 定数の部分木を畳み込み、恒等式を簡約する。
+// 新しいノードはarenaから確保し、元のノードも書き換える。
+// 木は明示的なスタックで後行順に辿るので、入れ子の深さによらず再帰しない
+struct ConstantFolder {
+    NodeArena& arena;
+
+    explicit ConstantFolder(NodeArena& arena) : arena(arena) {}
+
+    // 畳み込んだ木を返す
+    Node* fold(Node* root) {
+        Node* result = root;
+        walk.run(&result, [this](Node** slot) { return visit(slot); },
+                 [this](Node** slot) { *slot = finish(*slot); });
+        return result;
+    }
+
+private:
+    // 畳み込んだ結果は親の子へのポインタ (slot) に直接書き戻す。文をまたいで使い回す
+    PostOrderWalk<Node**> walk;
+    std::vector<const Node*> nodes;
+    std::vector<std::pair<const Node*, const Node*>> pairs;
+
+    void push(Node** slot, bool visited) {
+        walk.push(slot, visited);
+    }
+
+    // 葉は畳み込むものがないので辿らない
+    static bool is_leaf(const Node* node) {
+        return node->kind == NodeKind::Num || node->kind == NodeKind::LVar;
+    }
+
+    // 自分と残りの子を積み、最初に畳み込む子を返す。なければnullptr
+    Node** visit(Node** slot) {
+        Node* node = *slot;
+        Node** first;
+        switch (node->kind) {
+        case NodeKind::Num:
+        case NodeKind::LVar:
+            return nullptr;
+        case NodeKind::Return:
+        case NodeKind::Neg:
+            push(slot, true);
+            first = &node->lhs;
+            break;
+        case NodeKind::Assign:
+            push(slot, true);
+            first = &node->rhs;
+            break;
+        default:
+            push(slot, true);
+            if (!is_leaf(node->rhs)) {
+                push(&node->rhs, false);
+            }
+            first = &node->lhs;
+            break;
+        }
+        return is_leaf(*first) ? nullptr : first;
+    }
+
+    // 子を畳み込み終えたnodeを簡約する
+    Node* finish(Node* node) {
+        switch (node->kind) {
+        case NodeKind::Return:
+        case NodeKind::Assign:
+            return node;
+        case NodeKind::Neg:
+            return negate(node->lhs, arena);
+        default:
+            break;
+        }
+
+        auto* lhs = node->lhs;
+        auto* rhs = node->rhs;
+        if (lhs->kind == NodeKind::Num && rhs->kind == NodeKind::Num) {
+            if (auto val = evaluate(node->kind, lhs->val, rhs->val)) {
+                return Node::new_number(arena, *val);
+            }
+            return node;
+        }
+
+        switch (node->kind) {
+        case NodeKind::Add:
+            if (is_number(rhs, 0)) return lhs;
+            if (is_number(lhs, 0)) return rhs;
+            break;
+        case NodeKind::Sub:
+            if (is_number(rhs, 0)) return lhs;
+            if (is_number(lhs, 0)) return negate(rhs, arena);
+            if (same_pure_value(*lhs, *rhs)) return Node::new_number(arena, 0);
+            break;
+        case NodeKind::Mul:
+            if (is_number(rhs, 1)) return lhs;
+            if (is_number(lhs, 1)) return rhs;
+            if (is_number(rhs, -1)) return negate(lhs, arena);
+            if (is_number(lhs, -1)) return negate(rhs, arena);
+            if ((is_number(rhs, 0) && is_pure(*lhs)) || (is_number(lhs, 0) && is_pure(*rhs))) {
+                return Node::new_number(arena, 0);
+            }
+            break;
+        case NodeKind::Div:
+            if (is_number(rhs, 1)) return lhs;
+            break;
+        case NodeKind::Equal:
+        case NodeKind::LessEqual:
+            if (same_pure_value(*lhs, *rhs)) return Node::new_number(arena, 1);
+            break;
+        case NodeKind::NotEqual:
+        case NodeKind::Less:
+            if (same_pure_value(*lhs, *rhs)) return Node::new_number(arena, 0);
+            break;
+        default:
+            break;
+        }
+        return node;
+    }
+
+    // 評価しても副作用がなく、実行時例外も起こさない式か
+    bool is_pure(const Node& root) {
+        nodes.clear();
+        nodes.push_back(&root);
+        while (!nodes.empty()) {
+            const auto* node = nodes.back();
+            nodes.pop_back();
+            switch (node->kind) {
+            case NodeKind::Num:
+            case NodeKind::LVar:
+                break;
+            case NodeKind::Assign:
+            case NodeKind::Div:
+            case NodeKind::Return:
+                return false;
+            case NodeKind::Neg:
+                nodes.push_back(node->lhs);
+                break;
+            default:
+                nodes.push_back(node->rhs);
+                nodes.push_back(node->lhs);
+                break;
+            }
+        }
+        return true;
+    }
+
+    // 同じ値になることが分かっている副作用のない式か
+    bool same_pure_value(const Node& a, const Node& b) {
+        pairs.clear();
+        pairs.push_back({&a, &b});
+        while (!pairs.empty()) {
+            auto [x, y] = pairs.back();
+            pairs.pop_back();
+            if (x->kind != y->kind) {
+                return false;
+            }
+            switch (x->kind) {
+            case NodeKind::Num:
+                if (x->val != y->val) {
+                    return false;
+                }
+                break;
+            case NodeKind::LVar:
+                if (x->offset != y->offset) {
+                    return false;
+                }
+                break;
+            case NodeKind::Assign:
+            case NodeKind::Div:
+            case NodeKind::Return:
+                return false;
+            case NodeKind::Neg:
+                pairs.push_back({x->lhs, y->lhs});
+                break;
+            default:
+                pairs.push_back({x->rhs, y->rhs});
+                pairs.push_back({x->lhs, y->lhs});
+                break;
+            }
+        }
+        return true;
+    }
+};
+
+
+inline void fold_constants(std::vector<Node*>& code, NodeArena& arena) {
+    ConstantFolder folder(arena);
+    for (auto& stmt : code) {
+        stmt = folder.fold(stmt);
+        HOKACC_TRACE(Opt, "fold: {}", to_string(*stmt));
+    }
+}
+
+}
@@ -1,15 +1,21 @@
 #pragma once
 
+#include <array>
+#include <cstdint>
 #include <string>
 #include <string_view>
-#include <unordered_map>
-#include <forward_list>
 #include <memory>
+#include <utility>
+#include <vector>
 
 #include <fmt/core.h>
 #include <spdlog/spdlog.h>
 
+#include "arena.hpp"
+#include "frame_layout.hpp"
+#include "interner.hpp"
 #include "token.hpp"
+#include "trace.hpp"
 
 namespace yhok::hokacc {
 
@@ -25,6 +31,8 @@ enum struct NodeKind {
     Less,
     LessEqual,
 
+    Neg,
+
     Assign,
 
     LVar,
@@ -45,6 +53,7 @@ inline std::string to_string(NodeKind kind) {
     case NodeKind::NotEqual: return "NotEqual";
     case NodeKind::Less: return "Less";
     case NodeKind::LessEqual: return "LessEqual";
+    case NodeKind::Neg: return "Neg";
     case NodeKind::Assign: return "Assign";
     case NodeKind::LVar: return "LVar";
     case NodeKind::Num: return "Num";
@@ -54,37 +63,42 @@ inline std::string to_string(NodeKind kind) {
 }
 
 
+struct Node;
+using NodeArena = ObjectArena<Node>;
+
+
+// Nodeは全てNodeArenaから確保され、子ノードの所有権もアリーナが持つ
 struct Node {
     NodeKind kind;
-    std::unique_ptr<Node> lhs = nullptr;
-    std::unique_ptr<Node> rhs = nullptr;
-    int val;  // for Num
+    Node* lhs = nullptr;
+    Node* rhs = nullptr;
+    std::int64_t val;  // for Num
     std::size_t offset;  // for LVar
 
-    static std::unique_ptr<Node> new_number(int val) {
-        auto node = std::make_unique<Node>();
+    static Node* new_number(NodeArena& arena, std::int64_t val) {
+        auto node = arena.create();
         node->kind = NodeKind::Num;
         node->val = val;
         return node;
     }
 
-    static std::unique_ptr<Node> new_binary_op(NodeKind kind, std::unique_ptr<Node> lhs, std::unique_ptr<Node> rhs) {
-        auto node = std::make_unique<Node>();
+    static Node* new_binary_op(NodeArena& arena, NodeKind kind, Node* lhs, Node* rhs) {
+        auto node = arena.create();
         node->kind = kind;
-        node->lhs = std::move(lhs);
-        node->rhs = std::move(rhs);
+        node->lhs = lhs;
+        node->rhs = rhs;
         return node;
     }
 
-    static std::unique_ptr<Node> new_unary_op(NodeKind kind, std::unique_ptr<Node> lhs) {
-        auto node = std::make_unique<Node>();
+    static Node* new_unary_op(NodeArena& arena, NodeKind kind, Node* lhs) {
+        auto node = arena.create();
         node->kind = kind;
-        node->lhs = std::move(lhs);
+        node->lhs = lhs;
         return node;
     }
 
-    static std::unique_ptr<Node> new_lvar(int offset) {
-        auto node = std::make_unique<Node>();
+    static Node* new_lvar(NodeArena& arena, int offset) {
+        auto node = arena.create();
         node->kind = NodeKind::LVar;
         node->offset = offset;
         return node;
@@ -96,167 +110,373 @@ inline std::string to_string(const Node& node) {
     return fmt::format("Node(addr: {}, kind: {}, lhs: {}, rhs: {}, val: {})",
                        (void*)&node,
                        to_string(node.kind),
-                       (void*)node.lhs.get(),
-                       (void*)node.rhs.get(),
+                       (void*)node.lhs,
+                       (void*)node.rhs,
                        node.val);
 }
 
 
-struct LVar {
-    std::string_view name;
-    std::size_t offset;
+// 二項演算子の表の1項目。powerが0のトークンは二項演算子ではない
+struct BinaryOperator {
+    std::uint8_t power = 0;  // 束縛力。大きいほど強く結びつく
+    bool right_assoc = false;
+    bool swap = false;  // a > b は b < a として作る
+    NodeKind kind = NodeKind::Add;
 };
 
+// TokenKindで引く二項演算子の表
+inline constexpr std::array<BinaryOperator, token_kind_count> binary_operators = [] {
+    std::array<BinaryOperator, token_kind_count> table{};
+    auto set = [&](TokenKind token, std::uint8_t power, NodeKind kind, bool right_assoc = false, bool swap = false) {
+        table[static_cast<std::size_t>(token)] = {power, right_assoc, swap, kind};
+    };
+    set(TokenKind::Assign, 1, NodeKind::Assign, true);
+    set(TokenKind::Equal, 2, NodeKind::Equal);
+    set(TokenKind::NotEqual, 2, NodeKind::NotEqual);
+    set(TokenKind::Less, 3, NodeKind::Less);
+    set(TokenKind::LessEqual, 3, NodeKind::LessEqual);
+    set(TokenKind::Greater, 3, NodeKind::Less, false, true);
+    set(TokenKind::GreaterEqual, 3, NodeKind::LessEqual, false, true);
+    set(TokenKind::Plus, 4, NodeKind::Add);
+    set(TokenKind::Minus, 4, NodeKind::Sub);
+    set(TokenKind::Star, 5, NodeKind::Mul);
+    set(TokenKind::Slash, 5, NodeKind::Div);
+    return table;
+}();
+
+constexpr const BinaryOperator& binary_operator(TokenKind kind) {
+    return binary_operators[static_cast<std::size_t>(kind)];
+}
+
+
+// 右辺を待っている演算子とその左辺。whereはBuilderがエラーを示すために覚えておく演算子の位置 (Parserでは空)
+template <typename Value, typename Where>
+struct PendingOperator {
+    Value lhs;  // 印なら使わない
+    const BinaryOperator* op;
+    [[no_unique_address]] Where where;
+};
+
+namespace expr_detail {
+// 右辺を待っている演算子のスタックには、二項演算子の他に開き括弧と単項マイナスの印を積む。
+// 印の束縛力は0なので、二項演算子をまとめるときにその手前で止まる
+inline constexpr BinaryOperator paren_mark{};
+inline constexpr BinaryOperator neg_mark{};
+}
+
+// 式の構文解析。右辺を待っている演算子の明示的なスタックを使うので、括弧や代入の連鎖がどれだけ深くても再帰しない。
+// Parserと、定数式の中でプログラムを評価するconst_eval.hppが共有する。木の作り方とトークンの読み方はbuilderが決める:
+//   peek() / consume(kind) / expect(kind)  トークンを読む
+//   where()                                 現在のトークンの位置 (二項演算子と単項マイナスのノードに渡す)
+//   primary()                               識別子か数を読んでノードを作る
+//   neg(operand, where) / binary(op, lhs, rhs, where)  ノードを作る
+// エラーを例外にせず値として覚えるbuilderは、エラーの後はpeekでEndOfFileを返せば、ここは途中の木を返して終わる。
+// pendingは呼び出しをまたいで使い回す (確保し直さない)
+template <typename Builder>
+constexpr auto parse_expr(Builder& b,
+                          std::vector<PendingOperator<typename Builder::Value, typename Builder::Where>>& pending) {
+    using Value = typename Builder::Value;
+    using Where = typename Builder::Where;
+    using expr_detail::neg_mark;
+    using expr_detail::paren_mark;
+
+    pending.clear();
+    // 右辺を待っている一番内側の演算子とその左辺。スタックの一番上をローカルに持っておき、
+    // 同じ強さの演算子が続く間はスタックに触れない。opがnullptrなら式の外側にいる
+    Value lhs{};
+    const BinaryOperator* op = nullptr;
+    Where where{};
+    auto push = [&](Value next_lhs, const BinaryOperator* next_op, Where next_where) {
+        if (op) {
+            auto& frame = pending.emplace_back();
+            frame.lhs = lhs;
+            frame.op = op;
+            frame.where = where;
+        }
+        lhs = next_lhs;
+        op = next_op;
+        where = next_where;
+    };
+    auto pop = [&] {
+        if (pending.empty()) {
+            op = nullptr;
+            return;
+        }
+        lhs = pending.back().lhs;
+        op = pending.back().op;
+        where = pending.back().where;
+        pending.pop_back();
+    };
+
+    std::size_t open_parens = 0;
+    for (;;) {
+        // 被演算子の位置: 単項演算子と開き括弧を積んでから、識別子か数を読む
+        if (b.peek() == TokenKind::Minus) {
+            push(Value{}, &neg_mark, b.where());
+            b.consume(TokenKind::Minus);
+        } else {
+            b.consume(TokenKind::Plus);
+        }
+        if (b.consume(TokenKind::LParen)) {
+            push(Value{}, &paren_mark, Where{});
+            ++open_parens;
+            continue;
+        }
+        Value node = b.primary();
+
+        // 演算子の位置: 閉じ括弧を閉じていき、二項演算子があれば積んで被演算子に戻る
+        for (;;) {
+            if (op == &neg_mark) {
+                node = b.neg(node, where);
+                pop();
+            }
+            const auto& next = binary_operator(b.peek());
+            if (next.power > 0) {
+                while (op && (op->power > next.power || (op->power == next.power && !next.right_assoc))) {
+                    node = b.binary(*op, lhs, node, where);
+                    pop();
+                }
+                push(node, &next, b.where());
+                b.consume(b.peek());
+                break;
+            }
+            if (open_parens > 0 && b.peek() == TokenKind::RParen) {
+                while (op != &paren_mark) {
+                    node = b.binary(*op, lhs, node, where);
+                    pop();
+                }
+                pop();
+                --open_parens;
+                b.consume(TokenKind::RParen);
+                continue;
+            }
+
+            // 式の終わり。閉じていない括弧があればここで ) を要求してエラーにする
+            if (open_parens > 0) {
+                b.expect(TokenKind::RParen);
+                return node;
+            }
+            while (op) {
+                node = b.binary(*op, lhs, node, where);
+                pop();
+            }
+            return node;
+        }
+    }
+}
 
+
+// 文法:
+//   program = stmt*
+//   stmt    = "return"? expr ";"
+//   expr    = 二項演算子 (binary_operatorsの束縛力に従う、=だけ右結合) で unary をつないだ列
+//   unary   = ("+" | "-")? primary
+//   primary = "(" expr ")" | ident | num
+// 式は右辺を待っている演算子の明示的なスタックで解析するので、括弧や代入の連鎖がどれだけ深くても再帰しない。
+// 構文解析の前に文を全て読み飛ばして変数の置き場所を決めておく (layout_frame)。
+// share_slotsなら生きている範囲の重ならない変数がスロットを共有し、読まれない値の代入は右辺だけを残す
 struct Parser {
     TokenConsumer consumer;
-    std::vector<std::unique_ptr<Node>> code;
-    std::unordered_map<std::string_view, LVar> lvars;
+    NodeArena nodes;
+    std::vector<Node*> code;
+    FrameLayout frame;
+    std::uint32_t statement = 0;  // 今読んでいる文の番号
 
-    Parser(TokenConsumer consumer) : consumer(consumer) {
+    Parser(TokenConsumer consumer, bool share_slots = false) : consumer(std::move(consumer)) {
+        layout_frame(share_slots);
         program();
     }
 
-    Parser(const std::forward_list<Token>& tokens, std::string_view origin)
+    Parser(const TokenBuffer& tokens, std::string_view origin, bool share_slots = false)
         : consumer(tokens, origin) {
+        layout_frame(share_slots);
         program();
     }
 
+    // 全体を先に構文解析せず、next_statement()で1文ずつ取り出す
+    static Parser streaming(std::string_view source) {
+        return Parser(TokenConsumer(source), Streaming{});
+    }
+
+    // streaming()で作ったパーサで、別のソースを最初から読み直す。
+    // アリーナや表は確保し直さずに使い回すので、続けて多くのソースをコンパイルするときに速い
+    void restart(std::string_view source, bool share_slots = false) {
+        consumer.restart(source);
+        nodes.clear();
+        code.clear();
+        layout_frame(share_slots);
+    }
+
+    // 文を全て読み飛ばして変数ごとに現れる文と読まれる文を記録し、スロットを割り当ててから先頭に戻る。
+    // 識別子の直後が = なら代入の左辺とみなす。それ以外 ((a) = 1 など) は読むとみなすので、範囲が広がるだけで安全
+    void layout_frame(bool share_slots) {
+        frame.clear();
+        auto start = consumer.mark();
+        std::uint32_t index = 0;
+        while (!consumer.at_eof()) {
+            if (auto id = consumer.consume_identifier()) {
+                frame.record(*id, index, consumer.peek() == TokenKind::Assign);
+                continue;
+            }
+            if (consumer.peek() == TokenKind::SemiColon) {
+                ++index;
+            }
+            consumer.consume(consumer.peek());
+        }
+        frame.assign(share_slots);
+        for (auto id : frame.order) {
+            HOKACC_TRACE(Parse, "lvar: {} at {}", consumer.interner().name(id), frame.offset(id));
+        }
+        consumer.restore(start);
+        statement = 0;
+    }
+
     void program() {
         while (!consumer.at_eof()) {
             code.push_back(stmt());
         }
     }
 
-    std::unique_ptr<Node> stmt() {
-        std::unique_ptr<Node> node;
+    // 次の文を構文解析して返す。終端ならnullptr。
+    // 前の文の構文木はこの呼び出しで捨てられるので、codeには積まない
+    Node* next_statement() {
+        if (consumer.at_eof()) {
+            return nullptr;
+        }
+        nodes.clear();
+        return stmt();
+    }
+
+    Node* stmt() {
+        Node* node;
 
         if (consumer.consume(TokenKind::Return)) {
-            node = Node::new_unary_op(NodeKind::Return, expr());
+            node = Node::new_unary_op(nodes, NodeKind::Return, expr());
         } else {
             node = expr();
         }
 
         consumer.expect(TokenKind::SemiColon);
+        ++statement;
 
-        spdlog::debug("stmt: {}", to_string(*node));
+        HOKACC_TRACE(Parse, "stmt: {}", to_string(*node));
         return node;
     }
 
-    std::unique_ptr<Node> expr() {
-        auto node = assign();
-        spdlog::debug("expr: {}", to_string(*node));
+    Node* expr() {
+        ExprBuilder builder{*this};
+        Node* node = parse_expr(builder, pending);
+        HOKACC_TRACE(Parse, "expr: {}", to_string(*node));
         return node;
     }
 
-    std::unique_ptr<Node> assign() {
-        auto node = equality();
-        if (consumer.consume(TokenKind::Assign)) {
-            node = Node::new_binary_op(NodeKind::Assign, std::move(node), assign());
+    Node* primary() {
+        Node* node = nullptr;
+        if (auto id = consumer.consume_identifier(); id){
+            node = Node::new_lvar(nodes, lvar_offset(*id));
+        } else {
+            node = Node::new_number(nodes, consumer.expect_number());
         }
-        spdlog::debug("assign: {}", to_string(*node));
+
+        HOKACC_TRACE(Parse, "primary: {}", to_string(*node));
         return node;
     }
 
-    std::unique_ptr<Node> equality() {
-        auto node = relational();
-        for (;;) {
-            if (consumer.consume(TokenKind::Equal)) {
-                node = Node::new_binary_op(NodeKind::Equal, std::move(node), relational());
-            } else if (consumer.consume(TokenKind::NotEqual)) {
-                node = Node::new_binary_op(NodeKind::NotEqual, std::move(node), relational());
-            } else {
-                break;
-            }
+    // 読み終えたばかりの変数のフレーム上のオフセット。
+    // 直後が = で、代入した値が後で読まれないならFrameLayout::no_slot
+    std::size_t lvar_offset(Symbol id) {
+        if (consumer.peek() == TokenKind::Assign) {
+            return frame.store_offset(id, statement);
         }
-        spdlog::debug("equality: {}", to_string(*node));
-        return node;
+        return frame.offset(id);
     }
 
-    std::unique_ptr<Node> relational() {
-        auto node = add();
+    // 次の文を構文解析せずに ; まで読み飛ばし、文を表すバイト列をkeyに追記する。
+    // keyには変数の名前の代わりにprimary()と同じオフセットが入り、
+    // 同じkeyの文からは同じコードが生成される。; の前に終端に達したらfalse。
+    // 読み飛ばした文を構文解析するには、読み始めのconsumer.offset()に戻す (rewind)
+    bool skim_statement(std::string& key) {
+        skim_start = statement;
+        auto append = [&](std::uint32_t word) {
+            key.append(reinterpret_cast<const char*>(&word), sizeof(word));
+        };
         for (;;) {
-            if (consumer.consume(TokenKind::Less)) {
-                node = Node::new_binary_op(NodeKind::Less, std::move(node), add());
-            } else if (consumer.consume(TokenKind::LessEqual)) {
-                node = Node::new_binary_op(NodeKind::LessEqual, std::move(node), add());
-            } else if (consumer.consume(TokenKind::Greater)) {
-                node = Node::new_binary_op(NodeKind::Less, add(), std::move(node));
-            } else if (consumer.consume(TokenKind::GreaterEqual)) {
-                node = Node::new_binary_op(NodeKind::LessEqual, add(), std::move(node));
+            auto kind = consumer.peek();
+            key += static_cast<char>(kind);
+            if (auto id = consumer.consume_identifier()) {
+                append(static_cast<std::uint32_t>(lvar_offset(*id)));
+            } else if (auto value = consumer.consume_number()) {
+                append(static_cast<std::uint32_t>(*value));
+            } else if (kind == TokenKind::EndOfFile) {
+                return false;
             } else {
-                break;
+                consumer.consume(kind);
+                if (kind == TokenKind::SemiColon) {
+                    ++statement;
+                    return true;
+                }
             }
         }
-        spdlog::debug("relational: {}", to_string(*node));
-        return node;
     }
 
-    std::unique_ptr<Node> add() {
-        auto node = mul();
-        for (;;) {
-            if (consumer.consume(TokenKind::Plus)) {
-                node = Node::new_binary_op(NodeKind::Add, std::move(node), mul());
-            } else if (consumer.consume(TokenKind::Minus)) {
-                node = Node::new_binary_op(NodeKind::Sub, std::move(node), mul());
-            } else {
-                break;
-            }
-        }
-        spdlog::debug("add: {}", to_string(*node));
-        return node;
+    // skim_statementで読み飛ばした文の先頭に戻る
+    void rewind(std::size_t offset) {
+        consumer.rewind(offset);
+        statement = skim_start;
     }
 
-    std::unique_ptr<Node> mul() {
-        auto node = unary();
-        for (;;) {
-            if (consumer.consume(TokenKind::Star)) {
-                node = Node::new_binary_op(NodeKind::Mul, std::move(node), unary());
-            } else if (consumer.consume(TokenKind::Slash)) {
-                node = Node::new_binary_op(NodeKind::Div, std::move(node), unary());
-            } else {
-                break;
-            }
+private:
+    // parse_exprに渡す。エラーはconsumerが例外で投げるので、演算子の位置は覚えない
+    struct ExprBuilder {
+        using Value = Node*;
+        struct Where {};
+
+        Parser& parser;
+
+        TokenKind peek() const {
+            return parser.consumer.peek();
         }
-        spdlog::debug("mul: {}", to_string(*node));
-        return node;
-    }
 
-    std::unique_ptr<Node> primary() {
-        std::unique_ptr<Node> node = nullptr;
-        if (consumer.consume(TokenKind::LParen)) {
-            node = expr();
-            consumer.expect(TokenKind::RParen);
-        } else if (auto id = consumer.consume_identifier(); id){
-            auto it = lvars.find(*id);
-            if (it == lvars.end()) {
-                std::size_t offset = (lvars.size() + 1) * 8;
-                lvars.insert({*id, {*id, offset}});
-                node = Node::new_lvar(offset);
-            } else {
-                node = Node::new_lvar(it->second.offset);
-            }
-        } else {
-            node = Node::new_number(consumer.expect_number());
+        bool consume(TokenKind kind) {
+            return parser.consumer.consume(kind);
         }
 
-        spdlog::debug("primary: {}", to_string(*node));
-        return node;
-    }
+        void expect(TokenKind kind) {
+            parser.consumer.expect(kind);
+        }
 
-    std::unique_ptr<Node> unary() {
-        std::unique_ptr<Node> node;
-        if (consumer.consume(TokenKind::Plus)) {
-            node = primary();
-        } else if (consumer.consume(TokenKind::Minus)) {
-            node = Node::new_binary_op(NodeKind::Sub, Node::new_number(0), primary());
-        } else {
-            node = primary();
+        Where where() const {
+            return {};
         }
 
-        spdlog::debug("unary: {}", to_string(*node));
-        return node;
+        Node* primary() {
+            return parser.primary();
+        }
+
+        Node* neg(Node* operand, Where) {
+            return Node::new_unary_op(parser.nodes, NodeKind::Neg, operand);
+        }
+
+        Node* binary(const BinaryOperator& op, Node* lhs, Node* rhs, Where) {
+            return parser.binary(op, lhs, rhs);
+        }
+    };
+
+    // 文をまたいで使い回す (確保し直さない)
+    std::vector<PendingOperator<Node*, ExprBuilder::Where>> pending;
+    std::uint32_t skim_start = 0;  // skim_statementで読み飛ばし始めた文の番号
+
+    Node* binary(const BinaryOperator& op, Node* lhs, Node* rhs) {
+        // 読まれない値の代入は、式の値として右辺だけを残す
+        if (op.kind == NodeKind::Assign && lhs->kind == NodeKind::LVar && lhs->offset == FrameLayout::no_slot) {
+            return rhs;
+        }
+        return op.swap ? Node::new_binary_op(nodes, op.kind, rhs, lhs) : Node::new_binary_op(nodes, op.kind, lhs, rhs);
     }
+
+    struct Streaming {};
+
+    Parser(TokenConsumer consumer, Streaming) : consumer(std::move(consumer)) {}
 };
 
 
@@ -0,0 +1,198 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+#include "instr.hpp"
+
+namespace yhok::hokacc {
+
+enum struct PeepholeRule : std::uint8_t {
+    PushPopSame,    // push R; pop R           -> (削除)
+    PushPopMove,    // push X; pop R           -> mov R, X
+    PushPopAround,  // push X; I...; pop R     -> I...; mov R, X   (Iがスタックにも X にも触れない)
+    LVarAddr,       // mov R, rbp; sub R, N    -> lea R, [rbp-N]
+    LVarLoad,       // lea R, [rbp-N]; mov R, [R] -> mov R, [rbp-N]
+    MovSelf,        // mov R, R                -> (削除)
+    Count,
+};
+
+inline constexpr std::size_t peephole_rule_count = static_cast<std::size_t>(PeepholeRule::Count);
+
+inline constexpr std::array<std::string_view, peephole_rule_count> peephole_rule_names = {
+    "push-pop-same",
+    "push-pop-move",
+    "push-pop-around",
+    "lvar-addr",
+    "lvar-load",
+    "mov-self",
+};
+
+inline std::optional<PeepholeRule> find_peephole_rule(std::string_view name) {
+    for (std::size_t i = 0; i < peephole_rule_count; ++i) {
+        if (peephole_rule_names[i] == name) {
+            return static_cast<PeepholeRule>(i);
+        }
+    }
+    return std::nullopt;
+}
+
+
+struct PeepholeOptions {
+    std::array<bool, peephole_rule_count> enabled = [] {
+        std::array<bool, peephole_rule_count> enabled{};
+        enabled.fill(true);
+        return enabled;
+    }();
+    std::size_t window = 4;  // 1つの規則が一度に見る命令数の上限
+
+    bool is_enabled(PeepholeRule rule) const {
+        return enabled[static_cast<std::size_t>(rule)];
+    }
+};
+
+
+// 規則ごとに削除した命令数
+struct PeepholeStats {
+    std::array<std::size_t, peephole_rule_count> removed{};
+
+    std::size_t total() const {
+        std::size_t sum = 0;
+        for (auto n : removed) {
+            sum += n;
+        }
+        return sum;
+    }
+};
+
+
+// 命令列を先頭から出力に積みながら、出力の末尾に規則が当てはまる限り書き換える。
+// 書き換えた結果がさらに前の命令と組み合わさる場合もその場で畳み込まれる
+struct PeepholeOptimizer {
+    const PeepholeOptions& options;
+    PeepholeStats stats;
+    std::vector<Instr> out;
+
+    explicit PeepholeOptimizer(const PeepholeOptions& options) : options(options) {}
+
+    void run(InstrList& code) {
+        out.clear();
+        out.reserve(code.instrs.size());
+        for (const auto& instr : code.instrs) {
+            out.push_back(instr);
+            while (rewrite_tail()) {
+            }
+        }
+        code.instrs.swap(out);
+    }
+
+private:
+    void count(PeepholeRule rule, std::size_t removed) {
+        stats.removed[static_cast<std::size_t>(rule)] += removed;
+    }
+
+    bool rewrite_tail() {
+        return rewrite_mov_self() || rewrite_push_pop() || rewrite_lvar_addr() || rewrite_lvar_load();
+    }
+
+    bool rewrite_mov_self() {
+        if (!options.is_enabled(PeepholeRule::MovSelf)) {
+            return false;
+        }
+        const auto& last = out.back();
+        if (last.op != Op::Mov || last.dst.kind != OperandKind::Reg || !(last.dst == last.src)) {
+            return false;
+        }
+        out.pop_back();
+        count(PeepholeRule::MovSelf, 1);
+        return true;
+    }
+
+    bool rewrite_push_pop() {
+        const auto& last = out.back();
+        if (last.op != Op::Pop || last.dst.kind != OperandKind::Reg) {
+            return false;
+        }
+        auto dst = last.dst;
+
+        // 対応するpushを探す。間の命令はスタックにも、pushした値のレジスタにも触れてはいけない
+        std::size_t limit = std::min(options.window, out.size());
+        for (std::size_t distance = 1; distance < limit; ++distance) {
+            auto& push = out[out.size() - 1 - distance];
+            if (push.op == Op::Push) {
+                auto src = push.dst;
+                bool adjacent = distance == 1;
+                auto rule = adjacent ? (src == dst ? PeepholeRule::PushPopSame : PeepholeRule::PushPopMove)
+                                     : PeepholeRule::PushPopAround;
+                if (!options.is_enabled(rule)) {
+                    return false;
+                }
+                for (std::size_t i = out.size() - distance; i + 1 < out.size(); ++i) {
+                    if (src.kind == OperandKind::Reg && out[i].writes(src.reg)) {
+                        return false;
+                    }
+                }
+                auto before = out.size();
+                out.pop_back();
+                out.erase(out.end() - distance);
+                if (!(src == dst)) {
+                    out.push_back(Instr{Op::Mov, dst, src});
+                }
+                count(rule, before - out.size());
+                return true;
+            }
+            if (push.touches_stack()) {
+                return false;
+            }
+        }
+        return false;
+    }
+
+    bool rewrite_lvar_addr() {
+        if (!options.is_enabled(PeepholeRule::LVarAddr) || out.size() < 2) {
+            return false;
+        }
+        const auto& sub = out[out.size() - 1];
+        const auto& mov = out[out.size() - 2];
+        if (sub.op != Op::Sub || sub.dst.kind != OperandKind::Reg || sub.src.kind != OperandKind::Imm
+            || mov.op != Op::Mov || !(mov.dst == sub.dst) || !mov.src.is_reg(Register::Rbp)) {
+            return false;
+        }
+        auto lea = Instr{Op::Lea, sub.dst, Operand::mem(Register::Rbp, -sub.src.value)};
+        out.pop_back();
+        out.back() = lea;
+        count(PeepholeRule::LVarAddr, 1);
+        return true;
+    }
+
+    bool rewrite_lvar_load() {
+        if (!options.is_enabled(PeepholeRule::LVarLoad) || out.size() < 2) {
+            return false;
+        }
+        const auto& load = out[out.size() - 1];
+        const auto& lea = out[out.size() - 2];
+        if (load.op != Op::Mov || load.dst.kind != OperandKind::Reg || load.src.kind != OperandKind::Mem
+            || load.src.value != 0 || load.src.reg != load.dst.reg
+            || lea.op != Op::Lea || !lea.dst.is_reg(load.dst.reg) || lea.src.scale != 0) {
+            return false;
+        }
+        auto mov = Instr{Op::Mov, load.dst, lea.src};
+        out.pop_back();
+        out.back() = mov;
+        count(PeepholeRule::LVarLoad, 1);
+        return true;
+    }
+};
+
+
+inline PeepholeStats optimize_peephole(InstrList& code, const PeepholeOptions& options) {
+    PeepholeOptimizer optimizer(options);
+    optimizer.run(code);
+    return optimizer.stats;
+}
+
+}
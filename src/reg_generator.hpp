@@ -0,0 +1,314 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+#include "error.hpp"
+#include "generator.hpp"
+#include "instr.hpp"
+#include "parser.hpp"
+#include "walk.hpp"
+
+namespace yhok::hokacc {
+
+// raxとrdxはidivが使うので割り当てには使わず、文の結果とスピルしたオペランドの置き場にする
+inline constexpr std::array<Register, 7> scratch_regs = {
+    Register::Rdi,
+    Register::Rsi,
+    Register::Rcx,
+    Register::R8,
+    Register::R9,
+    Register::R10,
+    Register::R11,
+};
+
+
+// 式の一時値をレジスタに置くコード生成器。
+// Sethi-Ullmanの番号付けで必要なレジスタ数が多い方の部分木から評価し、
+// スクラッチレジスタが足りなくなったときだけスタックに退避する。
+// 番号付けも生成も明示的なスタックで木を辿るので、入れ子の深さによらず再帰しない
+struct RegGenerator {
+    InstrList& out;
+    // 定数のオペランドをレジスタに置かずに即値で使い、定数の乗除算を軽い命令に置き換える (-O1以上)
+    bool use_immediates = false;
+
+    struct Label {
+        int need;  // 評価に必要なレジスタ数
+        bool has_assign;  // 代入を含むなら評価順を入れ替えられない
+    };
+    std::unordered_map<const Node*, Label> labels;
+
+    explicit RegGenerator(InstrList& out) : out(out) {}
+
+    // 文を生成する。式文の値はraxに残す
+    void generate_stmt(const Node& node) {
+        // 前の文の生成がエラーで中断していたら、積み残しを捨てる
+        labels.clear();
+        label_walk.clear();
+        stack.clear();
+        if (node.kind == NodeKind::Return) {
+            label(*node.lhs);
+            generate(*node.lhs, 0);
+            out.emit(Op::Mov, regs::rax, Operand::reg64(scratch_regs[0]));
+            generate_epilogue(out);
+            return;
+        }
+        label(node);
+        generate(node, 0);
+        out.emit(Op::Mov, regs::rax, Operand::reg64(scratch_regs[0]));
+    }
+
+private:
+    enum struct Stage : std::uint8_t {
+        Start,    // まだ何も生成していない
+        Spill,    // 左辺の値を求めたので退避して右辺に進む
+        Finish,   // 子の値が揃ったので演算する
+    };
+
+    struct Frame {
+        const Node* node;
+        std::size_t base;  // 値を求めるscratch_regsの位置
+        Stage stage;
+    };
+
+    // 二項演算の評価の仕方
+    struct Plan {
+        bool swap;  // 右辺から評価する
+        bool in_registers;  // 2つ目の部分木をbase + 1以降のレジスタだけで評価できる
+    };
+
+    // 文をまたいで使い回す
+    std::vector<Frame> stack;
+    PostOrderWalk<const Node*> label_walk;
+
+    void push(const Node* node, std::size_t base, Stage stage) {
+        auto& frame = stack.emplace_back();
+        frame.node = node;
+        frame.base = base;
+        frame.stage = stage;
+    }
+
+    // rootの全ての部分木の番号をlabelsに入れる
+    void label(const Node& root) {
+        label_walk.run(&root, [this](const Node* node) { return start_label(*node); },
+                       [this](const Node* node) { labels.emplace(node, combine_labels(*node)); });
+    }
+
+    // 葉なら番号を付けてnullptrを返す。そうでなければ自分と残りの子を積み、最初に辿る子を返す
+    const Node* start_label(const Node& node) {
+        switch (node.kind) {
+        case NodeKind::Num:
+        case NodeKind::LVar:
+            labels.emplace(&node, Label{1, false});
+            return nullptr;
+        case NodeKind::Neg:
+            label_walk.push(&node, true);
+            return node.lhs;
+        case NodeKind::Assign:
+            if (node.lhs->kind != NodeKind::LVar) {
+                fail("Expected LVar, but got {}", to_string(*node.lhs));
+            }
+            label_walk.push(&node, true);
+            return node.rhs;
+        default:
+            label_walk.push(&node, true);
+            if (auto imm = immediate(node)) {
+                return imm->other;
+            }
+            label_walk.push(node.rhs, false);
+            return node.lhs;
+        }
+    }
+
+    // 子の番号から自分の番号を求める
+    Label combine_labels(const Node& node) const {
+        switch (node.kind) {
+        case NodeKind::Neg:
+            return labels.at(node.lhs);
+        case NodeKind::Assign:
+            return {labels.at(node.rhs).need, true};
+        default: {
+            // 即値のオペランドにはレジスタが要らない
+            if (auto imm = immediate(node)) {
+                return labels.at(imm->other);
+            }
+            const auto& l = labels.at(node.lhs);
+            const auto& r = labels.at(node.rhs);
+            return {l.need == r.need ? l.need + 1 : std::max(l.need, r.need), l.has_assign || r.has_assign};
+        }
+        }
+    }
+
+    std::optional<ImmediateOperand> immediate(const Node& node) const {
+        return use_immediates ? immediate_operand(node) : std::nullopt;
+    }
+
+    Plan plan(const Node& node, std::size_t base) const {
+        const auto& l = labels.at(node.lhs);
+        const auto& r = labels.at(node.rhs);
+        std::size_t rest = scratch_regs.size() - base - 1;
+
+        // 右辺の方が多くのレジスタを必要とし、入れ替えても副作用の順序が変わらないなら右辺から評価する
+        bool swap = r.need > l.need && !l.has_assign && !r.has_assign;
+        int second_need = swap ? l.need : r.need;
+        return {swap, static_cast<std::size_t>(second_need) <= rest};
+    }
+
+    // nodeの値をscratch_regs[base]に求める。scratch_regs[base]以降を自由に使ってよい
+    void generate(const Node& root, std::size_t base) {
+        const Node* node = &root;
+        for (;;) {
+            // 最初に評価する子は親と同じレジスタに求めるので、baseを変えずにそのまま降りる
+            while (node) {
+                node = start(*node, base);
+            }
+            if (stack.empty()) {
+                return;
+            }
+            const Node* top = stack.back().node;
+            base = stack.back().base;
+            auto stage = stack.back().stage;
+            stack.pop_back();
+            switch (stage) {
+            case Stage::Start:
+                node = top;
+                break;
+            case Stage::Spill:
+                // レジスタが足りないので左辺の値をスタックに退避しておく
+                out.emit(Op::Push, Operand::reg64(scratch_regs[base]));
+                push(top, base, Stage::Finish);
+                node = top->rhs;
+                break;
+            case Stage::Finish:
+                finish(*top, base);
+                break;
+            }
+        }
+    }
+
+    // 葉ならそのまま生成してnullptrを返す。そうでなければ自分と残りの子を積み、最初に評価する子を返す
+    const Node* start(const Node& node, std::size_t base) {
+        auto dst = Operand::reg64(scratch_regs[base]);
+        switch (node.kind) {
+        case NodeKind::Num:
+            out.emit(Op::Mov, dst, Operand::imm(node.val));
+            return nullptr;
+        case NodeKind::LVar:
+            out.emit(Op::Mov, dst, Operand::mem(Register::Rbp, -static_cast<std::int64_t>(node.offset)));
+            return nullptr;
+        case NodeKind::Neg:
+            push(&node, base, Stage::Finish);
+            return node.lhs;
+        case NodeKind::Assign:
+            push(&node, base, Stage::Finish);
+            return node.rhs;
+        default:
+            break;
+        }
+
+        if (auto imm = immediate(node)) {
+            push(&node, base, Stage::Finish);
+            return imm->other;
+        }
+        auto [swap, in_registers] = plan(node, base);
+        if (!in_registers) {
+            push(&node, base, Stage::Spill);
+            return node.lhs;
+        }
+        push(&node, base, Stage::Finish);
+        push(swap ? node.lhs : node.rhs, base + 1, Stage::Start);
+        return swap ? node.rhs : node.lhs;
+    }
+
+    // 子の値が揃った後の処理
+    void finish(const Node& node, std::size_t base) {
+        auto dst = Operand::reg64(scratch_regs[base]);
+        switch (node.kind) {
+        case NodeKind::Neg:
+            out.emit(Op::Neg, dst);
+            return;
+        case NodeKind::Assign:
+            out.emit(Op::Mov, Operand::mem(Register::Rbp, -static_cast<std::int64_t>(node.lhs->offset)), dst);
+            return;
+        default:
+            break;
+        }
+
+        if (auto imm = immediate(node)) {
+            if (node.kind == NodeKind::Div) {
+                generate_div_imm(dst, dst, imm->value, out);
+            } else {
+                generate_immediate_op(node.kind, dst, *imm, out);
+            }
+            return;
+        }
+        auto [swap, in_registers] = plan(node, base);
+        if (!in_registers) {
+            out.emit(Op::Pop, regs::rax);
+            combine(node.kind, Register::Rax, dst.reg);
+            out.emit(Op::Mov, dst, regs::rax);
+            return;
+        }
+        auto tmp = Operand::reg64(scratch_regs[base + 1]);
+        if (swap) {
+            combine(node.kind, tmp.reg, dst.reg);
+            out.emit(Op::Mov, dst, tmp);
+        } else {
+            combine(node.kind, dst.reg, tmp.reg);
+        }
+    }
+
+    // lhs = lhs op rhs
+    void combine(NodeKind kind, Register lhs, Register rhs) {
+        auto l = Operand::reg64(lhs);
+        auto r = Operand::reg64(rhs);
+        switch (kind) {
+        case NodeKind::Add:
+            out.emit(Op::Add, l, r);
+            return;
+        case NodeKind::Sub:
+            out.emit(Op::Sub, l, r);
+            return;
+        case NodeKind::Mul:
+            out.emit(Op::Imul, l, r);
+            return;
+        case NodeKind::Div:
+            if (lhs != Register::Rax) {
+                out.emit(Op::Mov, regs::rax, l);
+            }
+            out.emit(Op::Cqo);
+            out.emit(Op::Idiv, r);
+            if (lhs != Register::Rax) {
+                out.emit(Op::Mov, l, regs::rax);
+            }
+            return;
+        case NodeKind::Equal:
+            compare(Op::Sete, lhs, rhs);
+            return;
+        case NodeKind::NotEqual:
+            compare(Op::Setne, lhs, rhs);
+            return;
+        case NodeKind::Less:
+            compare(Op::Setl, lhs, rhs);
+            return;
+        case NodeKind::LessEqual:
+            compare(Op::Setle, lhs, rhs);
+            return;
+        default:
+            fail("Unknown node kind: {}", to_string(kind));
+        }
+    }
+
+    void compare(Op set, Register lhs, Register rhs) {
+        out.emit(Op::Cmp, Operand::reg64(lhs), Operand::reg64(rhs));
+        out.emit(set, Operand::reg8(lhs));
+        out.emit(Op::Movzx, Operand::reg64(lhs), Operand::reg8(lhs));
+    }
+};
+
+}
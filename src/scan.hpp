@@ -0,0 +1,181 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+// CMakeのHOKACC_LEXER_SIMDで切り替える (0にするとスカラー実装のみを使う)
+#ifndef HOKACC_LEXER_SIMD
+#define HOKACC_LEXER_SIMD 1
+#endif
+
+#if HOKACC_LEXER_SIMD && defined(__AVX2__)
+#include <immintrin.h>
+#define HOKACC_SCAN_WIDTH 32
+#elif HOKACC_LEXER_SIMD && defined(__SSE2__)
+#include <emmintrin.h>
+#define HOKACC_SCAN_WIDTH 16
+#else
+#define HOKACC_SCAN_WIDTH 0
+#endif
+
+namespace yhok::hokacc {
+
+// 文字の分類。ロケールに依存しないようにASCIIだけを対象にする
+namespace char_class {
+inline constexpr std::uint8_t Space = 1 << 0;
+inline constexpr std::uint8_t Alpha = 1 << 1;
+inline constexpr std::uint8_t Digit = 1 << 2;
+inline constexpr std::uint8_t Underscore = 1 << 3;
+
+inline constexpr std::uint8_t IdentStart = Alpha;
+inline constexpr std::uint8_t IdentContinue = Alpha | Digit | Underscore;
+}
+
+inline constexpr std::array<std::uint8_t, 256> char_table = [] {
+    std::array<std::uint8_t, 256> table{};
+    for (int c : {' ', '\t', '\n', '\v', '\f', '\r'}) {
+        table[c] |= char_class::Space;
+    }
+    for (int c = 'a'; c <= 'z'; ++c) {
+        table[c] |= char_class::Alpha;
+    }
+    for (int c = 'A'; c <= 'Z'; ++c) {
+        table[c] |= char_class::Alpha;
+    }
+    for (int c = '0'; c <= '9'; ++c) {
+        table[c] |= char_class::Digit;
+    }
+    table['_'] |= char_class::Underscore;
+    return table;
+}();
+
+constexpr bool has_class(char c, std::uint8_t cls) {
+    return (char_table[static_cast<unsigned char>(c)] & cls) != 0;
+}
+
+
+namespace scan_detail {
+
+#if HOKACC_SCAN_WIDTH == 32
+
+inline constexpr std::ptrdiff_t width = 32;
+inline constexpr std::uint32_t full_mask = 0xFFFFFFFFu;
+using Vec = __m256i;
+
+inline Vec load(const char* p) { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)); }
+inline Vec splat(char c) { return _mm256_set1_epi8(c); }
+inline Vec eq(Vec a, Vec b) { return _mm256_cmpeq_epi8(a, b); }
+inline Vec sub(Vec a, Vec b) { return _mm256_sub_epi8(a, b); }
+inline Vec min_u8(Vec a, Vec b) { return _mm256_min_epu8(a, b); }
+inline Vec bit_or(Vec a, Vec b) { return _mm256_or_si256(a, b); }
+inline std::uint32_t movemask(Vec v) { return static_cast<std::uint32_t>(_mm256_movemask_epi8(v)); }
+
+#elif HOKACC_SCAN_WIDTH == 16
+
+inline constexpr std::ptrdiff_t width = 16;
+inline constexpr std::uint32_t full_mask = 0xFFFFu;
+using Vec = __m128i;
+
+inline Vec load(const char* p) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); }
+inline Vec splat(char c) { return _mm_set1_epi8(c); }
+inline Vec eq(Vec a, Vec b) { return _mm_cmpeq_epi8(a, b); }
+inline Vec sub(Vec a, Vec b) { return _mm_sub_epi8(a, b); }
+inline Vec min_u8(Vec a, Vec b) { return _mm_min_epu8(a, b); }
+inline Vec bit_or(Vec a, Vec b) { return _mm_or_si128(a, b); }
+inline std::uint32_t movemask(Vec v) { return static_cast<std::uint32_t>(_mm_movemask_epi8(v)); }
+
+#endif
+
+#if HOKACC_SCAN_WIDTH > 0
+
+// lo <= v <= lo + span (符号なし比較) を満たすバイトを全ビット1にする
+inline Vec in_range(Vec v, char lo, char span) {
+    auto d = sub(v, splat(lo));
+    return eq(min_u8(d, splat(span)), d);
+}
+
+inline std::uint32_t space_mask(const char* p) {
+    auto v = load(p);
+    return movemask(bit_or(eq(v, splat(' ')), in_range(v, '\t', '\r' - '\t')));
+}
+
+inline std::uint32_t ident_mask(const char* p) {
+    auto v = load(p);
+    auto lower = bit_or(v, splat(0x20));
+    auto alpha = in_range(lower, 'a', 'z' - 'a');
+    auto digit = in_range(v, '0', '9' - '0');
+    return movemask(bit_or(bit_or(alpha, digit), eq(v, splat('_'))));
+}
+
+inline std::uint32_t digit_mask(const char* p) {
+    return movemask(in_range(load(p), '0', '9' - '0'));
+}
+
+#else
+
+// スカラー実装のみ。以下のマスク関数は呼ばれない
+inline constexpr std::ptrdiff_t width = 0;
+inline constexpr std::uint32_t full_mask = 0;
+
+inline std::uint32_t space_mask(const char*) { return 0; }
+inline std::uint32_t ident_mask(const char*) { return 0; }
+inline std::uint32_t digit_mask(const char*) { return 0; }
+
+#endif
+
+// 長い連続をベクタ幅ずつまとめて判定し、端数はテーブルで1文字ずつ見る
+template <std::uint8_t cls, std::uint32_t (*mask)(const char*)>
+[[gnu::noinline]] const char* skip_while_long(const char* p, const char* end) {
+    if constexpr (width > 0) {
+        while (end - p >= width) {
+            auto m = mask(p);
+            if (m != full_mask) {
+                return p + __builtin_ctz(~m);
+            }
+            p += width;
+        }
+    }
+    while (p != end && has_class(*p, cls)) {
+        ++p;
+    }
+    return p;
+}
+
+// ベクタで判定すると次の位置がロードの結果に依存して投機実行が効かなくなる。
+// 大半の連続は短いので、最初のprefix文字は分岐予測の効くテーブル参照で見る。
+// 定数式の中ではベクタ命令を使えないので、残りもテーブルで見る
+template <std::uint8_t cls, std::uint32_t (*mask)(const char*), std::ptrdiff_t prefix>
+constexpr const char* skip_while(const char* p, const char* end) {
+    for (std::ptrdiff_t i = 0; i < prefix; ++i, ++p) {
+        if (p == end || !has_class(*p, cls)) {
+            return p;
+        }
+    }
+    if (std::is_constant_evaluated()) {
+        while (p != end && has_class(*p, cls)) {
+            ++p;
+        }
+        return p;
+    }
+    return skip_while_long<cls, mask>(p, end);
+}
+
+}
+
+
+// 空白はトークン間の1文字が大半で、それを超えるとインデントや空行で長く続きやすい
+constexpr const char* skip_space(const char* p, const char* end) {
+    return scan_detail::skip_while<char_class::Space, scan_detail::space_mask, 2>(p, end);
+}
+
+constexpr const char* skip_ident(const char* p, const char* end) {
+    return scan_detail::skip_while<char_class::IdentContinue, scan_detail::ident_mask, 16>(p, end);
+}
+
+constexpr const char* skip_digits(const char* p, const char* end) {
+    return scan_detail::skip_while<char_class::Digit, scan_detail::digit_mask, 16>(p, end);
+}
+
+}
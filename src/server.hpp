@@ -0,0 +1,462 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <spdlog/spdlog.h>
+
+#include "asm_writer.hpp"
+#include "compiler.hpp"
+#include "driver.hpp"
+#include "error.hpp"
+
+namespace yhok::hokacc {
+
+// コンパイルサーバとのやりとりは、4バイトのリトルエンディアンの長さに本体が続くフレームで行う。
+//   要求の本体: 空白区切りのコンパイルの引数 (-O1 --emit=obj など、空でもよい) の行、改行、ソース
+//   応答の本体: ResponseStatusの1バイトに続いて、出力 (アセンブリかオブジェクトファイル) かエラーメッセージ
+enum struct ResponseStatus : std::uint8_t {
+    Ok = 0,
+    Error = 1,
+};
+
+// 長さを読んだだけで巨大な確保をしないように、フレームの大きさを制限する。
+// ワーカーの数だけ同時に確保されうるので、1つは64MiBまでにしておく
+inline constexpr std::size_t max_frame_size = std::size_t(64) << 20;
+
+
+// fdからちょうどsizeバイト読む。1バイトも読まないうちに終端に達したらfalse
+inline bool read_exact(int fd, void* data, std::size_t size) {
+    auto p = static_cast<char*>(data);
+    std::size_t done = 0;
+    while (done < size) {
+        auto n = ::read(fd, p + done, size - done);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            fail("Failed to read a frame: {}", std::strerror(errno));
+        }
+        if (n == 0) {
+            if (done == 0) {
+                return false;
+            }
+            fail("Connection closed in the middle of a frame");
+        }
+        done += n;
+    }
+    return true;
+}
+
+
+// フレームを1つ読んでbodyに入れる。bodyの容量は使い回す。フレームの前で終端に達したらfalse
+inline bool read_frame(int fd, std::string& body) {
+    unsigned char header[4];
+    if (!read_exact(fd, header, sizeof(header))) {
+        return false;
+    }
+    std::size_t size = header[0] | header[1] << 8 | header[2] << 16 | std::size_t(header[3]) << 24;
+    if (size > max_frame_size) {
+        fail("Frame too large: {} bytes", size);
+    }
+    body.resize(size);
+    if (size > 0 && !read_exact(fd, body.data(), size)) {
+        fail("Connection closed in the middle of a frame");
+    }
+    return true;
+}
+
+
+// partsをつなげたものを本体とするフレームを書く。本体はコピーせずにまとめてwritevする。
+// ソケットにはMSG_NOSIGNALで送り、相手が閉じていてもSIGPIPEで落ちずにエラーにする
+inline void write_frame(int fd, std::initializer_list<std::string_view> parts) {
+    std::size_t size = 0;
+    for (auto part : parts) {
+        size += part.size();
+    }
+    if (size > max_frame_size) {
+        fail("Frame too large: {} bytes", size);
+    }
+    unsigned char header[4] = {
+        static_cast<unsigned char>(size),
+        static_cast<unsigned char>(size >> 8),
+        static_cast<unsigned char>(size >> 16),
+        static_cast<unsigned char>(size >> 24),
+    };
+
+    std::vector<iovec> iov;
+    iov.reserve(parts.size() + 1);
+    iov.push_back({header, sizeof(header)});
+    for (auto part : parts) {
+        if (!part.empty()) {
+            iov.push_back({const_cast<char*>(part.data()), part.size()});
+        }
+    }
+
+    bool socket = true;
+    std::size_t first = 0;
+    while (first < iov.size()) {
+        ssize_t n;
+        if (socket) {
+            msghdr message{};
+            message.msg_iov = &iov[first];
+            message.msg_iovlen = iov.size() - first;
+            n = ::sendmsg(fd, &message, MSG_NOSIGNAL);
+            // 標準出力などソケットでなければwritevで書く
+            if (n < 0 && errno == ENOTSOCK) {
+                socket = false;
+                continue;
+            }
+        } else {
+            n = ::writev(fd, &iov[first], static_cast<int>(iov.size() - first));
+        }
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            fail("Failed to write a frame: {}", std::strerror(errno));
+        }
+        // 書けた分だけ先頭を進める
+        auto rest = static_cast<std::size_t>(n);
+        while (first < iov.size() && rest >= iov[first].iov_len) {
+            rest -= iov[first].iov_len;
+            ++first;
+        }
+        if (rest > 0) {
+            iov[first].iov_base = static_cast<char*>(iov[first].iov_base) + rest;
+            iov[first].iov_len -= rest;
+        }
+    }
+}
+
+
+// 1つのワーカーが要求を処理するための状態。
+// 構文木のアリーナ、識別子の表、命令列や出力のバッファを要求をまたいで使い回す
+struct ServerSession {
+    // 要求の引数は、サーバの起動時に指定した引数に上書きする形で解釈する
+    explicit ServerSession(const CompileOptions& options = {}, Emit emit = Emit::Asm)
+        : default_options(options), default_emit(emit) {}
+
+    // fdから要求を読んではfdに応答を書く。相手が閉じたら戻る
+    void serve(int in_fd, int out_fd) {
+        while (serve_one(in_fd, out_fd)) {
+        }
+    }
+
+    // 要求を1つ読んで応答を書く。相手が閉じていたらfalse
+    bool serve_one(int in_fd, int out_fd) {
+        if (!read_frame(in_fd, request)) {
+            return false;
+        }
+        respond(out_fd);
+        return true;
+    }
+
+private:
+    CompileOptions default_options;
+    Emit default_emit;
+    StreamingCompiler compiler{true};
+    AsmWriter out = AsmWriter::to_memory();
+    std::string request;
+
+    // コンパイルエラーはエラーの応答として返し、接続は続ける
+    void respond(int fd) {
+        auto status = ResponseStatus::Ok;
+        out.clear();
+        try {
+            compile_request();
+        } catch (const CompileError& error) {
+            status = ResponseStatus::Error;
+            out.clear();
+            std::string_view message = error.what();
+            out.write(message.data(), message.size());
+        }
+        // フレームに収まらない出力は、接続を切らずにエラーの応答にしてクライアントが区別できるようにする
+        if (out.str().size() + 1 > max_frame_size) {
+            status = ResponseStatus::Error;
+            auto message = fmt::format("Output too large: {} bytes", out.str().size());
+            out.clear();
+            out.write(message.data(), message.size());
+        }
+        char status_byte = static_cast<char>(status);
+        write_frame(fd, {std::string_view(&status_byte, 1), out.str()});
+    }
+
+    void compile_request() {
+        std::string_view body = request;
+        auto newline = body.find('\n');
+        if (newline == std::string_view::npos) {
+            fail("Malformed request: no newline after the flags");
+        }
+        auto flags = body.substr(0, newline);
+        auto source = body.substr(newline + 1);
+
+        auto options = default_options;
+        auto emit = default_emit;
+        while (!flags.empty()) {
+            auto end = flags.find(' ');
+            auto flag = flags.substr(0, end);
+            flags = end == std::string_view::npos ? std::string_view{} : flags.substr(end + 1);
+            if (!flag.empty() && !parse_compile_flag(flag, options, emit)) {
+                fail("Unknown flag in request: {}", flag);
+            }
+        }
+        if (!writes_output(emit)) {
+            fail("--jit and --eval cannot be used with the compile server");
+        }
+        compile_to(source, options, emit, out, compiler);
+    }
+};
+
+
+// Unixドメインソケットで待ち受けるコンパイルサーバ。
+// ワーカーはそれぞれ自分のServerSessionを持ち、共有のepollから読めるようになった接続を1つ受け取って、
+// 要求を1つだけ処理してからepollに戻す。待っているだけの接続がワーカーを占めることはなく、
+// 1つの接続の要求は順に、別々の接続の要求は並行に処理する
+struct CompileServer {
+    // pathに同名のソケットが残っていれば消してから作る
+    CompileServer(std::string path, std::size_t workers, const CompileOptions& options = {}, Emit emit = Emit::Asm)
+        : path(std::move(path)) {
+        auto address = socket_address(this->path);
+        listen_fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (listen_fd < 0) {
+            fail("Failed to create a socket: {}", std::strerror(errno));
+        }
+        ::unlink(this->path.c_str());
+        if (::bind(listen_fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 ||
+            ::listen(listen_fd, SOMAXCONN) != 0) {
+            auto error = errno;
+            close_fds();
+            fail("Failed to listen on {}: {}", this->path, std::strerror(error));
+        }
+        epoll_fd = ::epoll_create1(EPOLL_CLOEXEC);
+        wake_fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        // wake_fdはstopで書くまで読めず、書いた後は読まないので全てのワーカーが起きる
+        if (epoll_fd < 0 || wake_fd < 0 || !watch(wake_fd, EPOLLIN, EPOLL_CTL_ADD) || !arm(listen_fd, EPOLL_CTL_ADD)) {
+            auto error = errno;
+            close_fds();
+            fail("Failed to set up epoll: {}", std::strerror(error));
+        }
+
+        threads.reserve(std::max<std::size_t>(workers, 1));
+        for (std::size_t i = 0; i < std::max<std::size_t>(workers, 1); ++i) {
+            threads.emplace_back([this, options, emit] { work(options, emit); });
+        }
+    }
+
+    CompileServer(const CompileServer&) = delete;
+    CompileServer& operator=(const CompileServer&) = delete;
+
+    ~CompileServer() {
+        stop();
+    }
+
+    // 待ち受けをやめ、ワーカーが処理中の要求を終えるまで待って、残っている接続を閉じる
+    void stop() {
+        if (listen_fd < 0) {
+            return;
+        }
+        stopping.store(true, std::memory_order_release);
+        std::uint64_t one = 1;
+        [[maybe_unused]] auto written = ::write(wake_fd, &one, sizeof(one));
+        wait();
+        for (int fd : connections) {
+            ::close(fd);
+        }
+        connections.clear();
+        close_fds();
+        ::unlink(path.c_str());
+    }
+
+    // ワーカーが全て終わるまで待つ (stopしない限り戻らない)
+    void wait() {
+        for (auto& thread : threads) {
+            if (thread.joinable()) {
+                thread.join();
+            }
+        }
+    }
+
+    static sockaddr_un socket_address(const std::string& path) {
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        if (path.size() >= sizeof(address.sun_path)) {
+            fail("Socket path too long: {}", path);
+        }
+        std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+        return address;
+    }
+
+private:
+    std::string path;
+    int listen_fd = -1;
+    int epoll_fd = -1;
+    int wake_fd = -1;
+    std::atomic<bool> stopping{false};
+    std::vector<std::thread> threads;
+
+    // stopで閉じるために、開いている接続を覚えておく
+    std::mutex connections_mutex;
+    std::unordered_set<int> connections;
+
+    void close_fds() {
+        for (int* fd : {&listen_fd, &epoll_fd, &wake_fd}) {
+            if (*fd >= 0) {
+                ::close(std::exchange(*fd, -1));
+            }
+        }
+    }
+
+    bool watch(int fd, std::uint32_t events, int op) {
+        epoll_event event{};
+        event.events = events;
+        event.data.fd = fd;
+        return ::epoll_ctl(epoll_fd, op, fd, &event) == 0;
+    }
+
+    // 次に読めるようになったとき、1つのワーカーだけが受け取るようにする
+    bool arm(int fd, int op = EPOLL_CTL_MOD) {
+        return watch(fd, EPOLLIN | EPOLLONESHOT, op);
+    }
+
+    // fdやメモリが一時的に足りないだけなら、少し待てばまたacceptできる
+    static bool transient_accept_error(int error) {
+        return error == EMFILE || error == ENFILE || error == ENOBUFS || error == ENOMEM;
+    }
+
+    void work(const CompileOptions& options, Emit emit) {
+        ServerSession session(options, emit);
+        for (;;) {
+            epoll_event event{};
+            int n = ::epoll_wait(epoll_fd, &event, 1, -1);
+            if (stopping.load(std::memory_order_acquire)) {
+                return;
+            }
+            if (n < 0) {
+                if (errno != EINTR) {
+                    spdlog::error("Failed to wait for connections, retrying: {}", std::strerror(errno));
+                    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                }
+                continue;
+            }
+            if (n == 0 || event.data.fd == wake_fd) {
+                continue;
+            }
+            if (event.data.fd == listen_fd) {
+                accept_connection();
+            } else {
+                serve_request(session, event.data.fd);
+            }
+        }
+    }
+
+    // stopするまではワーカーを減らさない。acceptのエラーが続いてもログを埋めないように間をおいて試し直す
+    void accept_connection() {
+        int fd = ::accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0) {
+            auto error = errno;
+            if (transient_accept_error(error)) {
+                spdlog::warn("Failed to accept a connection, retrying: {}", std::strerror(error));
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            } else if (error != EAGAIN && error != EINTR && error != ECONNABORTED) {
+                spdlog::error("Failed to accept a connection, retrying: {}", std::strerror(error));
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            }
+        } else {
+            std::lock_guard lock(connections_mutex);
+            if (arm(fd, EPOLL_CTL_ADD)) {
+                connections.insert(fd);
+            } else {
+                spdlog::warn("Failed to watch a connection: {}", std::strerror(errno));
+                ::close(fd);
+            }
+        }
+        arm(listen_fd);
+    }
+
+    // 壊れたフレームや切断、確保の失敗などはその接続だけを閉じる
+    void serve_request(ServerSession& session, int fd) {
+        bool open = false;
+        try {
+            open = session.serve_one(fd, fd);
+        } catch (const std::exception& error) {
+            spdlog::warn("{}", error.what());
+        }
+        if (open && arm(fd)) {
+            return;
+        }
+        std::lock_guard lock(connections_mutex);
+        connections.erase(fd);
+        ::close(fd);
+    }
+};
+
+
+// コンパイルサーバへの接続。要求を送って応答を待つのを繰り返す
+struct CompileClient {
+    static CompileClient connect(const std::string& path) {
+        auto address = CompileServer::socket_address(path);
+        int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0) {
+            fail("Failed to create a socket: {}", std::strerror(errno));
+        }
+        CompileClient client(fd);
+        if (::connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0) {
+            fail("Failed to connect to {}: {}", path, std::strerror(errno));
+        }
+        return client;
+    }
+
+    CompileClient(const CompileClient&) = delete;
+    CompileClient& operator=(const CompileClient&) = delete;
+
+    CompileClient(CompileClient&& other) : fd(std::exchange(other.fd, -1)) {}
+
+    CompileClient& operator=(CompileClient&&) = delete;
+
+    ~CompileClient() {
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+
+    // flagsは空白区切りのコンパイルの引数。出力またはエラーメッセージをoutputに入れて状態を返す
+    ResponseStatus request(std::string_view flags, std::string_view source, std::string& output) {
+        if (flags.find('\n') != std::string_view::npos) {
+            fail("Flags must not contain a newline");
+        }
+        write_frame(fd, {flags, "\n", source});
+        if (!read_frame(fd, response) || response.empty()) {
+            fail("The compile server closed the connection");
+        }
+        output.assign(response, 1);
+        return static_cast<ResponseStatus>(response[0]);
+    }
+
+private:
+    explicit CompileClient(int fd) : fd(fd) {}
+
+    int fd;
+    std::string response;
+};
+
+}
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <ctime>
+#include <iterator>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <sys/resource.h>
+
+#include <fmt/format.h>
+#include <spdlog/spdlog.h>
+
+namespace yhok::hokacc {
+
+// このスレッドのヒープ確保の回数とバイト数。operator newを置き換えたバイナリ
+// (src/alloc_hook.cppをリンクしたhokaccとhokacc_bench) でだけ増え、それ以外では0のままになる。
+// スレッドごとに持つので、-jやサーバのワーカーが確保のたびに同じキャッシュラインを取り合うことはない
+struct AllocationCounter {
+    static inline thread_local std::size_t count = 0;
+    static inline thread_local std::size_t bytes = 0;
+
+    static void record(std::size_t size) {
+        ++count;
+        bytes += size;
+    }
+};
+
+
+struct PhaseStats {
+    std::string name;
+    std::uint64_t wall_ns = 0;
+    std::uint64_t cpu_ns = 0;  // このスレッドのCPU時間
+    std::size_t allocations = 0;
+    std::size_t allocated_bytes = 0;
+    std::size_t peak_rss_kib = 0;  // フェーズの終わりまでのプロセスの最大RSS
+};
+
+
+// 1回のコンパイルの、フェーズごとの時間・メモリと入力の規模 (--stats)
+struct CompileStats {
+    std::vector<PhaseStats> phases;
+    std::size_t input_bytes = 0;
+    std::size_t tokens = 0;
+    std::size_t nodes = 0;
+    std::size_t variables = 0;
+    std::size_t instrs = 0;  // 出力した命令の数
+
+    PhaseStats total() const {
+        PhaseStats sum{"total"};
+        for (const auto& phase : phases) {
+            sum.wall_ns += phase.wall_ns;
+            sum.cpu_ns += phase.cpu_ns;
+            sum.allocations += phase.allocations;
+            sum.allocated_bytes += phase.allocated_bytes;
+            sum.peak_rss_kib = std::max(sum.peak_rss_kib, phase.peak_rss_kib);
+        }
+        return sum;
+    }
+
+    void report() const {
+        auto print = [](const PhaseStats& p) {
+            spdlog::info("{:<24} {:>10.1f} us wall {:>10.1f} us cpu {:>8} allocs {:>10} bytes {:>8} KiB peak RSS",
+                         p.name, p.wall_ns / 1000.0, p.cpu_ns / 1000.0, p.allocations, p.allocated_bytes,
+                         p.peak_rss_kib);
+        };
+        for (const auto& phase : phases) {
+            print(phase);
+        }
+        print(total());
+        spdlog::info("{} bytes, {} tokens, {} nodes, {} variables, {} instructions",
+                     input_bytes, tokens, nodes, variables, instrs);
+    }
+
+    // 改行を含まない1つのJSONオブジェクト
+    std::string json() const {
+        fmt::memory_buffer out;
+        auto phase_json = [&](const PhaseStats& p) {
+            fmt::format_to(std::back_inserter(out),
+                           "{{\"name\":\"{}\",\"wall_ns\":{},\"cpu_ns\":{},\"allocations\":{},"
+                           "\"allocated_bytes\":{},\"peak_rss_kib\":{}}}",
+                           p.name, p.wall_ns, p.cpu_ns, p.allocations, p.allocated_bytes, p.peak_rss_kib);
+        };
+        fmt::format_to(std::back_inserter(out), "{{\"phases\":[");
+        for (std::size_t i = 0; i < phases.size(); ++i) {
+            if (i > 0) {
+                out.push_back(',');
+            }
+            phase_json(phases[i]);
+        }
+        fmt::format_to(std::back_inserter(out), "],\"total\":");
+        phase_json(total());
+        fmt::format_to(std::back_inserter(out),
+                       ",\"input_bytes\":{},\"tokens\":{},\"nodes\":{},\"variables\":{},\"instrs\":{}}}",
+                       input_bytes, tokens, nodes, variables, instrs);
+        return fmt::to_string(out);
+    }
+};
+
+
+// 前にlapを呼んでから (最初は作ってから) の時間と確保をフェーズとしてstatsに記録する。
+// statsがnullなら何もしないので、統計を取らないコンパイルではほぼ只で置いておける
+struct PhaseClock {
+    explicit PhaseClock(CompileStats* stats) : stats(stats) {
+        if (stats) {
+            mark = now();
+        }
+    }
+
+    void lap(std::string name) {
+        if (!stats) {
+            return;
+        }
+        auto next = now();
+        rusage usage{};
+        ::getrusage(RUSAGE_SELF, &usage);
+        stats->phases.push_back({
+            std::move(name),
+            next.wall_ns - mark.wall_ns,
+            next.cpu_ns - mark.cpu_ns,
+            next.allocations - mark.allocations,
+            next.allocated_bytes - mark.allocated_bytes,
+            static_cast<std::size_t>(usage.ru_maxrss),  // LinuxではKiB
+        });
+        // 記録にかかった分を次のフェーズに含めないように測り直す
+        mark = now();
+    }
+
+private:
+    struct Mark {
+        std::uint64_t wall_ns;
+        std::uint64_t cpu_ns;
+        std::size_t allocations;
+        std::size_t allocated_bytes;
+    };
+
+    CompileStats* stats;
+    Mark mark{};
+
+    static std::uint64_t read_clock(clockid_t clock) {
+        timespec ts;
+        ::clock_gettime(clock, &ts);
+        return static_cast<std::uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+    }
+
+    static Mark now() {
+        return {
+            read_clock(CLOCK_MONOTONIC),
+            read_clock(CLOCK_THREAD_CPUTIME_ID),
+            AllocationCounter::count,
+            AllocationCounter::bytes,
+        };
+    }
+};
+
+}
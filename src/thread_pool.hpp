@@ -0,0 +1,76 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+namespace yhok::hokacc {
+
+// 件数の決まった独立なジョブをスレッドで分担する、ワークスティーリング方式のプール。
+// ジョブは最初に各スレッドのキューへ順に配り、自分のキューが空になったスレッドは
+// 他のキューの反対側の端から盗む。ジョブの重さがばらついても、最後までどのスレッドも遊ばない
+struct WorkStealingPool {
+    explicit WorkStealingPool(std::size_t thread_count) : queues(std::max<std::size_t>(thread_count, 1)) {}
+
+    // job(i) を i = 0, ..., count - 1 について呼び、全て終わるまで待つ。
+    // jobは並行に呼ばれるので、ジョブ間で共有する状態を書き換えてはいけない
+    template <typename Job>
+    void run(std::size_t count, Job&& job) {
+        for (std::size_t i = 0; i < count; ++i) {
+            queues[i % queues.size()].jobs.push_back(i);
+        }
+        auto worker = [&](std::size_t self) {
+            while (auto index = take(self)) {
+                job(*index);
+            }
+        };
+
+        // 呼び出したスレッドも0番の担当として働く
+        std::vector<std::thread> threads;
+        threads.reserve(queues.size() - 1);
+        for (std::size_t t = 1; t < queues.size(); ++t) {
+            threads.emplace_back(worker, t);
+        }
+        worker(0);
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<std::size_t> jobs;
+    };
+
+    std::vector<Queue> queues;
+
+    // 自分のキューは後ろから、他のキューは前から取る。全て空ならnullopt
+    std::optional<std::size_t> take(std::size_t self) {
+        {
+            auto& own = queues[self];
+            std::lock_guard lock(own.mutex);
+            if (!own.jobs.empty()) {
+                auto index = own.jobs.back();
+                own.jobs.pop_back();
+                return index;
+            }
+        }
+        for (std::size_t k = 1; k < queues.size(); ++k) {
+            auto& victim = queues[(self + k) % queues.size()];
+            std::lock_guard lock(victim.mutex);
+            if (!victim.jobs.empty()) {
+                auto index = victim.jobs.front();
+                victim.jobs.pop_front();
+                return index;
+            }
+        }
+        return std::nullopt;
+    }
+};
+
+}
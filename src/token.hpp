@@ -1,17 +1,26 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <limits>
 #include <string>
 #include <string_view>
-#include <forward_list>
 #include <memory>
 #include <optional>
+#include <vector>
 
 #include <fmt/core.h>
 #include <spdlog/spdlog.h>
 
+#include "error.hpp"
+#include "interner.hpp"
+#include "scan.hpp"
+#include "trace.hpp"
+
 namespace yhok::hokacc {
 
-enum struct TokenKind {
+enum struct TokenKind : std::uint8_t {
     // Reserved
     LParen,
     RParen,
@@ -34,6 +43,8 @@ enum struct TokenKind {
     EndOfFile    // EOF
 };
 
+inline constexpr std::size_t token_kind_count = static_cast<std::size_t>(TokenKind::EndOfFile) + 1;
+
 inline std::string to_string(TokenKind kind) {
     switch (kind) {
     case TokenKind::LParen: return "LParen";
@@ -82,6 +93,7 @@ inline std::string to_literal_string(TokenKind kind) {
     }
 }
 
+// 診断メッセージ用のトークンのビュー
 struct Token {
     TokenKind kind;
     std::size_t loc;
@@ -90,220 +102,554 @@ struct Token {
 };
 
 
+// トークン列をstruct-of-arraysで1つのバッファに詰めて保持する。
+// Numberトークンの値は出現順にvaluesへ、Identifierトークンのシンボルは出現順にsymbolsへ入れる。
+struct TokenBuffer {
+    TokenBuffer() = default;
+    TokenBuffer(const TokenBuffer&) = delete;
+    TokenBuffer& operator=(const TokenBuffer&) = delete;
+    TokenBuffer(TokenBuffer&&) = default;
+    TokenBuffer& operator=(TokenBuffer&&) = default;
+
+    std::size_t size() const {
+        return count;
+    }
+
+    TokenKind kind(std::size_t i) const {
+        return kinds[i];
+    }
+
+    std::uint32_t offset(std::size_t i) const {
+        return offsets[i];
+    }
+
+    std::uint32_t length(std::size_t i) const {
+        return lengths[i];
+    }
+
+    // literal番目のNumberトークンの値
+    int value(std::size_t literal) const {
+        return values[literal];
+    }
+
+    std::size_t literal_count() const {
+        return values.size();
+    }
+
+    // ident番目のIdentifierトークンのシンボル
+    Symbol symbol(std::size_t ident) const {
+        return symbols[ident];
+    }
+
+    // 識別子の名前とシンボルの対応
+    const Interner& interner() const {
+        return names;
+    }
+
+    void push(TokenKind kind, std::size_t offset, std::size_t length) {
+        if (count == capacity) {
+            reserve(capacity == 0 ? 64 : capacity * 2);
+        }
+        kinds[count] = kind;
+        offsets[count] = static_cast<std::uint32_t>(offset);
+        lengths[count] = static_cast<std::uint32_t>(length);
+        ++count;
+    }
+
+    void push_number(std::size_t offset, std::size_t length, int value) {
+        push(TokenKind::Number, offset, length);
+        values.push_back(value);
+    }
+
+    void push_identifier(std::size_t offset, std::size_t length, std::string_view name) {
+        push(TokenKind::Identifier, offset, length);
+        symbols.push_back(names.intern(name));
+    }
+
+    void reserve(std::size_t n) {
+        if (n <= capacity) {
+            return;
+        }
+        // [offsets | lengths | kinds] の順に並べて、4バイトの配列のアラインメントを保つ
+        std::unique_ptr<std::byte[]> block(new std::byte[n * bytes_per_token]);
+        auto* new_offsets = reinterpret_cast<std::uint32_t*>(block.get());
+        auto* new_lengths = new_offsets + n;
+        auto* new_kinds = reinterpret_cast<TokenKind*>(new_lengths + n);
+        std::copy_n(offsets, count, new_offsets);
+        std::copy_n(lengths, count, new_lengths);
+        std::copy_n(kinds, count, new_kinds);
+        storage = std::move(block);
+        offsets = new_offsets;
+        lengths = new_lengths;
+        kinds = new_kinds;
+        capacity = n;
+    }
+
+    // 確保済みのバイト数
+    std::size_t memory_usage() const {
+        return capacity * bytes_per_token + values.capacity() * sizeof(int) + symbols.capacity() * sizeof(Symbol);
+    }
+
+    static constexpr std::size_t bytes_per_token = sizeof(std::uint32_t) * 2 + sizeof(TokenKind);
+
+private:
+    std::unique_ptr<std::byte[]> storage;
+    std::uint32_t* offsets = nullptr;
+    std::uint32_t* lengths = nullptr;
+    TokenKind* kinds = nullptr;
+    std::size_t count = 0;
+    std::size_t capacity = 0;
+    std::vector<int> values;
+    std::vector<Symbol> symbols;
+    Interner names;
+};
+
+
 inline std::string to_string(const Token& token) {
     return fmt::format("Token(kind: {}, loc: {}, value: {}, str: {})", to_string(token.kind), token.loc, token.value, token.str);
 }
 
 
-inline std::unique_ptr<std::forward_list<Token>> tokenize(std::string_view str) {
-    auto tokens = std::make_unique<std::forward_list<Token>>();
-    // ダミーの先頭トークン
-    tokens->push_front(Token{});
+// 予約語の表。ここに足すだけで字句解析器が認識する
+struct Keyword {
+    std::string_view text;
+    TokenKind kind;
+};
+
+inline constexpr Keyword keywords[] = {
+    {"return", TokenKind::Return},
+};
+
 
-    // 最後尾のトークンのイテレータ
-    auto it = tokens->begin();
+namespace keyword_detail {
 
-    spdlog::debug("Tokenizing: {}", str);
+inline constexpr std::size_t table_size = [] {
+    std::size_t size = 8;
+    while (size < std::size(keywords) * 2) {
+        size *= 2;
+    }
+    return size;
+}();
 
-    std::size_t loc = 0;
-    auto c = str.begin();
-    while (c != str.end()) {
-        loc = c - str.begin();
-        if (std::isspace(*c)) {
-            ++c;
-            continue;
-        }
-        if (*c == '!') {
-            if ((c + 1) != str.end() && *(c + 1) == '=') {
-                it = tokens->insert_after(it, Token{TokenKind::NotEqual, loc, 0, std::string_view(c, 2)});
-                c = c + 2;
-                continue;
-            }
-        }
-        if (*c == '=') {
-            if ((c + 1) != str.end() && *(c + 1) == '=') {
-                it = tokens->insert_after(it, Token{TokenKind::Equal, loc, 0, std::string_view(c, 2)});
-                c = c + 2;
-                continue;
-            } else {
-                it = tokens->insert_after(it, Token{TokenKind::Assign, loc, 0, std::string_view(c, 1)});
-                ++c;
-                continue;
-            }
-        }
-        if (*c == '<') {
-            if ((c + 1) != str.end() && *(c + 1) == '=') {
-                it = tokens->insert_after(it, Token{TokenKind::LessEqual, loc, 0, std::string_view(c, 2)});
-                c = c + 2;
-                continue;
-            } else {
-                it = tokens->insert_after(it, Token{TokenKind::Less, loc, 0, std::string_view(c, 1)});
-                ++c;
-                continue;
-            }
-        }
-        if (*c == '>') {
-            if ((c + 1) != str.end() && *(c + 1) == '=') {
-                it = tokens->insert_after(it, Token{TokenKind::GreaterEqual, loc, 0, std::string_view(c, 2)});
-                c = c + 2;
-                continue;
-            } else {
-                it = tokens->insert_after(it, Token{TokenKind::Greater, loc, 0, std::string_view(c, 1)});
-                ++c;
-                continue;
-            }
-        }
-        if (*c == '+') {
-            it = tokens->insert_after(it, Token{TokenKind::Plus, loc, 0, std::string_view(c, 1)});
-            ++c;
-            continue;
+inline constexpr std::size_t max_length = [] {
+    std::size_t length = 0;
+    for (const auto& keyword : keywords) {
+        length = std::max(length, keyword.text.size());
+    }
+    return length;
+}();
+
+constexpr std::uint32_t hash(std::string_view word, std::uint32_t seed) {
+    auto first = static_cast<unsigned char>(word.front());
+    auto last = static_cast<unsigned char>(word.back());
+    auto h = (first * seed) ^ (last + static_cast<std::uint32_t>(word.size()) * 0x9E3779B1u);
+    return (h ^ (h >> 15)) & (table_size - 1);
+}
+
+// 全ての予約語が衝突しないseedをコンパイル時に探す
+inline constexpr std::uint32_t seed = [] {
+    for (std::uint32_t seed = 1;; ++seed) {
+        bool used[table_size] = {};
+        bool perfect = true;
+        for (const auto& keyword : keywords) {
+            auto h = hash(keyword.text, seed);
+            perfect = perfect && !used[h];
+            used[h] = true;
         }
-        if (*c == '-') {
-            it = tokens->insert_after(it, Token{TokenKind::Minus, loc, 0, std::string_view(c, 1)});
-            ++c;
-            continue;
+        if (perfect) {
+            return seed;
         }
-        if (*c == '/') {
-            it = tokens->insert_after(it, Token{TokenKind::Slash, loc, 0, std::string_view(c, 1)});
-            ++c;
-            continue;
+    }
+}();
+
+inline constexpr std::array<Keyword, table_size> table = [] {
+    std::array<Keyword, table_size> table{};
+    for (auto& entry : table) {
+        entry = {"", TokenKind::Identifier};
+    }
+    for (const auto& keyword : keywords) {
+        table[hash(keyword.text, seed)] = keyword;
+    }
+    return table;
+}();
+
+}
+
+// 識別子が予約語ならその種類を、そうでなければIdentifierを返す
+constexpr TokenKind keyword_or_identifier(std::string_view word) {
+    if (word.size() > keyword_detail::max_length) {
+        return TokenKind::Identifier;
+    }
+    const auto& entry = keyword_detail::table[keyword_detail::hash(word, keyword_detail::seed)];
+    return entry.text == word ? entry.kind : TokenKind::Identifier;
+}
+
+
+// 記号1文字のトークン。該当しない文字はEndOfFileにしておく
+inline constexpr std::array<TokenKind, 256> punct_table = [] {
+    std::array<TokenKind, 256> table{};
+    for (auto& kind : table) {
+        kind = TokenKind::EndOfFile;
+    }
+    table['('] = TokenKind::LParen;
+    table[')'] = TokenKind::RParen;
+    table['='] = TokenKind::Assign;
+    table['<'] = TokenKind::Less;
+    table['>'] = TokenKind::Greater;
+    table[';'] = TokenKind::SemiColon;
+    table['+'] = TokenKind::Plus;
+    table['-'] = TokenKind::Minus;
+    table['/'] = TokenKind::Slash;
+    table['*'] = TokenKind::Star;
+    return table;
+}();
+
+// 後ろに'='が続く記号2文字のトークン
+inline constexpr std::array<TokenKind, 256> punct_eq_table = [] {
+    std::array<TokenKind, 256> table{};
+    for (auto& kind : table) {
+        kind = TokenKind::EndOfFile;
+    }
+    table['='] = TokenKind::Equal;
+    table['!'] = TokenKind::NotEqual;
+    table['<'] = TokenKind::LessEqual;
+    table['>'] = TokenKind::GreaterEqual;
+    return table;
+}();
+
+
+// 字句解析の結果の1トークン。Numberならvalueに値が入る
+struct LexedToken {
+    TokenKind kind;
+    std::uint32_t offset;
+    std::uint32_t length;
+    int value;
+    Symbol symbol = 0;  // Identifierのとき
+};
+
+
+// 字句解析のエラー。ホットパスに入らないよう分けておく
+[[noreturn, gnu::noinline]] inline void lex_error(std::string_view source, std::size_t loc, std::size_t length,
+                                                  std::string_view message) {
+    fail_at(source, loc, length, fmt::format("{}:", message), message);
+}
+
+// sinkがerrorを持てばエラーを値として渡し (定数式の中で評価するconst_eval.hpp)、なければ例外を投げる
+template <typename Sink>
+constexpr void scan_error(Sink& sink, std::string_view source, std::size_t loc, std::size_t length,
+                          std::string_view message) {
+    if constexpr (requires { sink.error(loc, length, message); }) {
+        sink.error(loc, length, message);
+    } else {
+        lex_error(source, loc, length, message);
+    }
+}
+
+// cの位置から1トークンを切り出してsinkに渡し (push / push_number / push_identifier)、cをその直後に進める。
+// 終端ではEOFを渡してfalseを返し、エラーをsinkに渡したときもfalseを返す。
+// tokenizeのループに展開させて、cをレジスタに置いたままにする。定数式の中でも使える
+template <typename Sink>
+[[gnu::always_inline]] constexpr bool scan_token(const char*& c, std::string_view source, Sink& sink) {
+    const char* const begin = source.data();
+    const char* const end = begin + source.size();
+    c = skip_space(c, end);
+    std::size_t loc = c - begin;
+    if (c == end) {
+        sink.push(TokenKind::EndOfFile, loc, 1);
+        return false;
+    }
+
+    if (has_class(*c, char_class::IdentStart)) {
+        const char* p = skip_ident(c + 1, end);
+        std::string_view word(c, p - c);
+        if (auto kind = keyword_or_identifier(word); kind != TokenKind::Identifier) {
+            sink.push(kind, loc, word.size());
+        } else {
+            sink.push_identifier(loc, word.size(), word);
         }
-        if (*c == '*') {
-            it = tokens->insert_after(it, Token{TokenKind::Star, loc, 0, std::string_view(c, 1)});
-            ++c;
-            continue;
+        c = p;
+        return true;
+    }
+    if (has_class(*c, char_class::Digit)) {
+        const char* p = skip_digits(c + 1, end);
+        std::int64_t n = 0;
+        for (const char* d = c; d != p && n <= std::numeric_limits<int>::max(); ++d) {
+            n = n * 10 + (*d - '0');
         }
-        if (*c == ';') {
-            it = tokens->insert_after(it, Token{TokenKind::SemiColon, loc, 0, std::string_view(c, 1)});
-            ++c;
-            continue;
+        if (n > std::numeric_limits<int>::max()) {
+            scan_error(sink, source, loc, p - c, "Number too large");
+            return false;
         }
-        if (*c == '(') {
-            it = tokens->insert_after(it, Token{TokenKind::LParen, loc, 0, std::string_view(c, 1)});
-            ++c;
-            continue;
+        sink.push_number(loc, p - c, static_cast<int>(n));
+        c = p;
+        return true;
+    }
+    if (c + 1 != end && c[1] == '=') {
+        auto kind = punct_eq_table[static_cast<unsigned char>(*c)];
+        if (kind != TokenKind::EndOfFile) {
+            sink.push(kind, loc, 2);
+            c += 2;
+            return true;
         }
-        if (*c == ')') {
-            it = tokens->insert_after(it, Token{TokenKind::RParen, loc, 0, std::string_view(c, 1)});
-            ++c;
-            continue;
+    }
+    if (auto kind = punct_table[static_cast<unsigned char>(*c)]; kind != TokenKind::EndOfFile) {
+        sink.push(kind, loc, 1);
+        ++c;
+        return true;
+    }
+
+    scan_error(sink, source, loc, 1, "Failed to tokenize");
+    return false;
+}
+
+inline void check_source_size(std::string_view source) {
+    if (source.size() >= std::numeric_limits<std::uint32_t>::max()) {
+        fail("Input too large to tokenize: {} bytes", source.size());
+    }
+}
+
+
+// 要求されるたびに1トークンずつ字句解析する。終端に達した後はEOFを返し続ける
+struct Lexer {
+    std::string_view source;
+    const char* c;
+    Interner interner;
+
+    explicit Lexer(std::string_view source) : source(source), c(source.data()) {
+        check_source_size(source);
+    }
+
+    // 別のソースを最初から読み直す。識別子の番号も0から振り直す
+    void restart(std::string_view next_source) {
+        check_source_size(next_source);
+        source = next_source;
+        c = next_source.data();
+        interner.clear();
+    }
+
+    // 同じソースのoffsetから読み直す。識別子の番号はそのまま
+    void seek(std::size_t offset) {
+        c = source.data() + offset;
+    }
+
+    LexedToken next() {
+        LexedToken token{};
+        Sink sink{token, interner};
+        scan_token(c, source, sink);
+        return token;
+    }
+
+private:
+    // scan_tokenの結果を1トークン分だけ受け取る
+    struct Sink {
+        LexedToken& token;
+        Interner& interner;
+
+        void push(TokenKind kind, std::size_t offset, std::size_t length) {
+            token = {kind, static_cast<std::uint32_t>(offset), static_cast<std::uint32_t>(length), 0};
         }
 
-        if (std::isdigit(*c)) {
-            std::size_t idx;
-            int n = std::stoi(c, &idx);
-            it = tokens->insert_after(it, Token{TokenKind::Number, loc, n, std::string_view(c, idx)});
-            c += idx;
-            continue;
+        void push_number(std::size_t offset, std::size_t length, int value) {
+            token = {TokenKind::Number, static_cast<std::uint32_t>(offset), static_cast<std::uint32_t>(length), value};
         }
-        if (std::isalpha(*c)) {
-            if (str.substr(loc, 6) == "return" && !(c + 6 != str.end() && (std::isalpha(*(c + 6)) || std::isdigit(*(c + 6)) || *(c + 6) == '_'))) {
-                it = tokens->insert_after(it, Token{TokenKind::Return, loc, 0, std::string_view(c, 6)});
-                c += 6;
-                continue;
-            } else {
-                auto* p = c + 1;
-                while (p != str.end() && (std::isalpha(*p) || std::isdigit(*p) || *p == '_')) {
-                    ++p;
-                }
-                std::size_t idx = p - c;
-                it = tokens->insert_after(it, Token{TokenKind::Identifier, loc, 0, std::string_view(c, idx)});
-                c += idx;
-                continue;
-            }
+
+        void push_identifier(std::size_t offset, std::size_t length, std::string_view name) {
+            token = {TokenKind::Identifier, static_cast<std::uint32_t>(offset), static_cast<std::uint32_t>(length), 0,
+                     interner.intern(name)};
         }
-        spdlog::error("Failed to tokenize:");
-        spdlog::error("{}", str);
-        spdlog::error("{:>{}}^ Failed to tokenize", "", loc);
-        std::exit(1);
-    }
+    };
+};
 
-    loc = c - str.begin();
-    it = tokens->insert_after(it, Token{TokenKind::EndOfFile, loc, 0, std::string_view(" ")});
 
-    // ダミーの先頭トークンを削除
-    tokens->pop_front();
+// 入力全体を字句解析してTokenBufferに入れる
+inline TokenBuffer tokenize(std::string_view str) {
+    check_source_size(str);
+    TokenBuffer tokens;
+    // 大抵のソースはトークン数が文字数の半分に収まる
+    tokens.reserve(str.size() / 2 + 16);
 
-    spdlog::debug("Finished tokenizing:");
-    for (const auto& token : *tokens) {
-        spdlog::debug("{}", to_string(token));
+    HOKACC_TRACE(Lex, "Tokenizing: {}", str);
+
+    // トークンバッファへの書き込みと別名にならないよう、位置はローカル変数で持つ
+    const char* c = str.data();
+    while (scan_token(c, str, tokens)) {
+    }
+
+    if (HOKACC_TRACING(Lex)) {
+        HOKACC_TRACE(Lex, "Finished tokenizing:");
+        for (std::size_t i = 0, literal = 0; i < tokens.size(); ++i) {
+            Token token{tokens.kind(i), tokens.offset(i), 0, str.substr(tokens.offset(i), tokens.length(i))};
+            if (token.kind == TokenKind::Number) {
+                token.value = tokens.value(literal++);
+            }
+            HOKACC_TRACE(Lex, "{}", to_string(token));
+        }
     }
 
     return tokens;
 }
 
 
+// トークンを先頭から順に読み進める。読み元は字句解析済みのTokenBufferか、
+// 要求されたときにだけ字句解析するLexerのどちらか。
+// 現在のトークンは常に1つ読んでおく。文法は1トークンの先読みで足りるので、それより先は見ない
 struct TokenConsumer {
-    const std::forward_list<Token>& tokens;
     std::string_view origin;
-    std::forward_list<Token>::const_iterator it;
 
-    TokenConsumer(const std::forward_list<Token>& tokens, std::string_view origin)
-        : tokens(tokens), origin(origin), it(tokens.begin()) {}
+    TokenConsumer(const TokenBuffer& tokens, std::string_view origin)
+        : origin(origin), buffer(&tokens) {
+        cur = read();
+    }
+
+    // ソースを少しずつ字句解析しながら読む
+    explicit TokenConsumer(std::string_view source)
+        : origin(source), lexer(std::in_place, source) {
+        cur = read();
+    }
+
+    // 別のソースを最初から字句解析し直す。ソースを少しずつ読むときだけ使える
+    void restart(std::string_view source) {
+        origin = source;
+        lexer->restart(source);
+        cur = read();
+    }
+
+    // 現在のトークンの位置 (rewindに渡せる)
+    std::size_t offset() const {
+        return cur.offset;
+    }
+
+    // ソースのoffsetにあるトークンから読み直す。ソースを少しずつ読むときだけ使える
+    void rewind(std::size_t offset) {
+        lexer->seek(offset);
+        cur = read();
+    }
+
+    // 読み位置を覚えておき、restoreでそこから読み直す。rewindと違ってどちらの読み元でも使える
+    struct Mark {
+        LexedToken cur;
+        std::size_t pos;
+        std::size_t literal;
+        std::size_t ident;
+    };
+
+    Mark mark() const {
+        return {cur, pos, literal, ident};
+    }
+
+    void restore(const Mark& mark) {
+        if (lexer) {
+            lexer->seek(mark.cur.offset);
+            cur = read();
+            return;
+        }
+        cur = mark.cur;
+        pos = mark.pos;
+        literal = mark.literal;
+        ident = mark.ident;
+    }
+
+    // 現在のトークンの種類
+    TokenKind peek() const {
+        return cur.kind;
+    }
+
+    Token current() const {
+        return Token{cur.kind, cur.offset, cur.value, origin.substr(cur.offset, cur.length)};
+    }
 
     bool consume(TokenKind kind) {
-        if (it->kind != kind) {
+        if (cur.kind != kind) {
             return false;
         }
-        ++it;
+        advance();
         return true;
     }
 
     void expect(TokenKind kind) {
-        if (it->kind != kind) {
+        if (cur.kind != kind) {
             auto keyword = to_literal_string(kind);
-            spdlog::error("Expected {}, but got {}", keyword, to_string(*it));
-            spdlog::error("{}", origin);
-            spdlog::error("{:>{}}^{:~>{}} Expected {}", "", it->loc, "", it->str.size() - 1, keyword);
-            std::exit(1);
+            error_at_current(fmt::format("Expected {}", keyword));
         }
-        ++it;
+        advance();
     }
 
     std::optional<int> consume_number() {
-        if (it->kind != TokenKind::Number) {
+        if (cur.kind != TokenKind::Number) {
             return std::nullopt;
         }
-        int val = it->value;
-        ++it;
+        int val = cur.value;
+        advance();
         return val;
     }
 
     int expect_number() {
-        if (it->kind != TokenKind::Number) {
-            spdlog::error("Expected number, but got {}", to_string(*it));
-            spdlog::error("{}", origin);
-            spdlog::error("{:>{}}^{:~>{}} Expected number", "", it->loc, "", it->str.size() - 1);
-            std::exit(1);
+        if (cur.kind != TokenKind::Number) {
+            error_at_current("Expected number");
         }
-        int val = it->value;
-        ++it;
+        int val = cur.value;
+        advance();
         return val;
     }
 
-    std::optional<std::string_view> consume_identifier() {
-        if (it->kind != TokenKind::Identifier) {
+    std::optional<Symbol> consume_identifier() {
+        if (cur.kind != TokenKind::Identifier) {
             return std::nullopt;
         }
-        std::string_view val = it->str;
-        ++it;
+        Symbol val = cur.symbol;
+        advance();
         return val;
     }
 
-    std::string_view expect_identifier() {
-        if (it->kind != TokenKind::Identifier) {
-            spdlog::error("Expected identifier, but got {}", to_string(*it));
-            spdlog::error("{}", origin);
-            spdlog::error("{:>{}}^{:~>{}} Expected identifier", "", it->loc, "", it->str.size() - 1);
-            std::exit(1);
+    Symbol expect_identifier() {
+        if (cur.kind != TokenKind::Identifier) {
+            error_at_current("Expected identifier");
         }
-        std::string_view val = it->str;
-        ++it;
+        Symbol val = cur.symbol;
+        advance();
         return val;
     }
 
-    bool at_eof() {
-        return it->kind == TokenKind::EndOfFile;
+    // シンボルと識別子の名前の対応
+    const Interner& interner() const {
+        return lexer ? lexer->interner : buffer->interner();
+    }
+
+    bool at_eof() const {
+        return cur.kind == TokenKind::EndOfFile;
+    }
+
+private:
+    LexedToken cur;
+
+    const TokenBuffer* buffer = nullptr;
+    std::size_t pos = 0;  // bufferから次に読むトークン
+    std::size_t literal = 0;  // bufferから次に読むNumberトークンの値のvalues上の位置
+    std::size_t ident = 0;  // bufferから次に読むIdentifierトークンのシンボルのsymbols上の位置
+    std::optional<Lexer> lexer;
+
+    LexedToken read() {
+        if (lexer) {
+            return lexer->next();
+        }
+        // EOFに達したらEOFを返し続ける
+        auto i = std::min(pos, buffer->size() - 1);
+        LexedToken token{buffer->kind(i), buffer->offset(i), buffer->length(i), 0};
+        if (token.kind == TokenKind::Number) {
+            token.value = buffer->value(literal++);
+        } else if (token.kind == TokenKind::Identifier) {
+            token.symbol = buffer->symbol(ident++);
+        }
+        pos = i + 1;
+        return token;
+    }
+
+    void advance() {
+        cur = read();
+    }
+
+    [[noreturn]] void error_at_current(std::string_view message) const {
+        fail_at(origin, cur.offset, cur.length, fmt::format("{}, but got {}", message, to_string(current())), message);
     }
 };
 
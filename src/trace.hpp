@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+#include <spdlog/spdlog.h>
+
+#ifndef HOKACC_ENABLE_TRACE
+#define HOKACC_ENABLE_TRACE 1
+#endif
+
+namespace yhok::hokacc::trace {
+
+enum struct Category : std::uint8_t {
+    Lex,      // トークン列
+    Parse,    // 文法規則ごとの構文木
+    Opt,      // 定数畳み込みとIRのパス
+    Codegen,  // レジスタ割り当てなど
+    Count,
+};
+
+inline constexpr std::string_view category_names[] = {"lex", "parse", "opt", "codegen"};
+
+// 有効なカテゴリのビット集合。実行時には--traceで設定する
+inline std::uint32_t enabled_categories = 0;
+
+inline bool enabled(Category category) {
+    return __builtin_expect((enabled_categories >> static_cast<int>(category)) & 1, 0);
+}
+
+inline std::optional<Category> find_category(std::string_view name) {
+    for (std::size_t i = 0; i < static_cast<std::size_t>(Category::Count); ++i) {
+        if (category_names[i] == name) {
+            return static_cast<Category>(i);
+        }
+    }
+    return std::nullopt;
+}
+
+// "all" またはカンマ区切りのカテゴリ名を有効にする
+inline bool enable(std::string_view list) {
+    if (list == "all") {
+        enabled_categories = (1u << static_cast<int>(Category::Count)) - 1;
+        return true;
+    }
+    while (!list.empty()) {
+        auto comma = list.find(',');
+        auto name = list.substr(0, comma);
+        auto category = find_category(name);
+        if (!category) {
+            spdlog::error("Unknown trace category: {}", name);
+            return false;
+        }
+        enabled_categories |= 1u << static_cast<int>(*category);
+        list = comma == std::string_view::npos ? std::string_view{} : list.substr(comma + 1);
+    }
+    return true;
+}
+
+}
+
+// カテゴリが有効か。HOKACC_ENABLE_TRACEが0なら定数のfalseになり、ガードした処理ごと消える
+#define HOKACC_TRACING(category) \
+    (HOKACC_ENABLE_TRACE && ::yhok::hokacc::trace::enabled(::yhok::hokacc::trace::Category::category))
+
+// 引数はカテゴリが有効なときだけ評価される。書式文字列は文字列リテラルで渡す
+#define HOKACC_TRACE(category, ...) \
+    do { \
+        if (HOKACC_TRACING(category)) { \
+            spdlog::debug("[" #category "] " __VA_ARGS__); \
+        } \
+    } while (0)
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <vector>
+
+namespace yhok::hokacc {
+
+// 木を明示的なスタックで後行順に辿る。再帰しないので、入れ子の深さによらずスタックは溢れない。
+// Itemはノードへのポインタなど、nullで「辿る子がない」を表せる型。
+// 各パスはstartとfinishだけを書く:
+//   start(item)  葉ならそのまま処理してnullを返す。そうでなければpushで自分 (visited) と残りの子を積み、
+//                最初に辿る子を返す。最初の子へはスタックを介さずにそのまま降りる
+//   finish(item) 子を全て辿り終えた要素を処理する
+template <typename Item>
+struct PostOrderWalk {
+    // visitedなら子を全て辿り終えたのでfinishを呼び、そうでなければまだ辿っていない子
+    constexpr void push(Item item, bool visited) {
+        auto& frame = stack.emplace_back();
+        frame.item = item;
+        frame.visited = visited;
+    }
+
+    // エラーで中断した辿りの積み残しを捨てる
+    constexpr void clear() {
+        stack.clear();
+    }
+
+    template <typename Start, typename Finish>
+    constexpr void run(Item root, Start&& start, Finish&& finish) {
+        Item item = root;
+        for (;;) {
+            while (item) {
+                item = start(item);
+            }
+            if (stack.empty()) {
+                return;
+            }
+            // Frameを丸ごとコピーすると、直前の狭い書き込みからの転送が効かずに待たされる
+            Item top = stack.back().item;
+            bool visited = stack.back().visited;
+            stack.pop_back();
+            if (visited) {
+                finish(top);
+            } else {
+                item = top;
+            }
+        }
+    }
+
+private:
+    struct Frame {
+        Item item;
+        bool visited;
+    };
+
+    // 文をまたいで使い回す
+    std::vector<Frame> stack;
+};
+
+}
@@ -0,0 +1,75 @@
+// 定数評価器のテスト。static_assertはこのファイルをビルドするときに定数式として確かめ、
+// mainは定数式で評価するには大きすぎる入力を実行時に確かめる (test/test.pyが実行する)
+#include <string>
+#include <string_view>
+
+#include <fmt/core.h>
+
+#include "const_eval.hpp"
+
+using namespace yhok::hokacc;
+
+static_assert(constant_value("a = 1; return a + 2;") == 3);
+static_assert(constant_value("1 + 2 * 3 - 4 / 2;") == 5);
+static_assert(constant_value("a = 2; (a = 5) + a * 2;") == 15);
+static_assert(constant_value("a = 8; c = 1; a > (a = c);") == 0);
+static_assert(constant_value("a = b = 3; -a * (b - -1) + +2;") == -10);
+static_assert(constant_value("x = 0 - 7; (x / 2) + (3 > x) * 10 + (x >= x) * 100 + (x != x);") == 107);
+static_assert(constant_value("-(-(2)) * -3 - -(1 + 1);") == -4);
+static_assert(constant_value("return 4; 1 / 0; return c;") == 4);
+static_assert(constant_value("") == 0);
+static_assert(constant_value("x = 65536 * 65536 * 65536 * 32768; x - 1 < x;") == 0);
+static_assert(evaluate_constant("1 / (2 - 2);").message == "Division by zero");
+static_assert(evaluate_constant("a + 1;").message == "Uninitialized variable");
+static_assert(evaluate_constant("1 = 2;").message == "Expected LVar");
+static_assert(evaluate_constant("(1 + 2;").loc == 6);
+static_assert(evaluate_constant("2147483648;").message == "Number too large");
+static_assert(compile<"a = 6; b = 7; return a * b;">() == 42);
+static_assert(compile<"(((((((((((((((((((((((((((((((((1)))))))))))))))))))))))))))))))));">() == 1);
+static_assert(evaluate_constant("a = b = c = d = 1; a + (b = 2) + c + d;").value == 5);
+static_assert(evaluate_constant("a = 1; (a = 2;").message == "Expected )");
+static_assert(evaluate_constant("a = 1 a;").message == "Expected ;");
+static_assert(evaluate_constant("1 + ;").message == "Expected number");
+static_assert(evaluate_constant("1 @ 2;").message == "Failed to tokenize");
+
+namespace {
+
+int failures = 0;
+
+void check(bool ok, std::string_view name) {
+    fmt::print("{}: {}\n", name, ok ? "ok" : "failed");
+    failures += ok ? 0 : 1;
+}
+
+std::string repeat(std::string_view s, std::size_t n) {
+    std::string out;
+    for (std::size_t i = 0; i < n; ++i) {
+        out += s;
+    }
+    return out;
+}
+
+}
+
+
+int main() {
+    // 定数式で評価するには大きすぎる入力
+    std::size_t depth = 100000;
+    auto nested = "a = " + repeat("1 - (", depth) + "3" + repeat(")", depth) + "; a * 2;";
+    auto result = evaluate_constant(nested);
+    check(result.ok && result.value == 6, "100000 nested parentheses");
+
+    auto chain = repeat("a = ", depth) + "7; a;";
+    result = evaluate_constant(chain);
+    check(result.ok && result.value == 7, "100000 chained assignments");
+
+    auto long_sum = "a = 1; " + repeat("a + ", depth) + "1;";
+    result = evaluate_constant(long_sum);
+    check(result.ok && result.value == 100001, "100000 additions");
+
+    auto unclosed = repeat("(", depth) + "1" + repeat(")", depth - 1) + ";";
+    result = evaluate_constant(unclosed);
+    check(!result.ok && result.message == "Expected )" && result.loc == 2 * depth, "unclosed parenthesis");
+
+    return failures == 0 ? 0 : 1;
+}
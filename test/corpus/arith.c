@@ -0,0 +1,84 @@
+x = 7;
+y = 3;
+z = 100;
+y = y + x / 7;
+x = x - x / 1000 * 1000; y = y - y / 1000 * 1000; z = z - z / 1000 * 1000;
+y = y + x / 7;
+x = x - x / 1000 * 1000; y = y - y / 1000 * 1000; z = z - z / 1000 * 1000;
+x = x * 3 + y;
+x = x - x / 1000 * 1000; y = y - y / 1000 * 1000; z = z - z / 1000 * 1000;
+y = y * 10 - x / 4;
+x = x - x / 1000 * 1000; y = y - y / 1000 * 1000; z = z - z / 1000 * 1000;
+x = (x + z) / 9 - y;
+x = x - x / 1000 * 1000; y = y - y / 1000 * 1000; z = z - z / 1000 * 1000;
+y = y + x / 7;
+x = x - x / 1000 * 1000; y = y - y / 1000 * 1000; z = z - z / 1000 * 1000;
+z = (z + 12) * 2 - (x - y) * 3;
+x = x - x / 1000 * 1000; y = y - y / 1000 * 1000; z = z - z / 1000 * 1000;
+x = x * 3 + y;
+x = x - x / 1000 * 1000; y = y - y / 1000 * 1000; z = z - z / 1000 * 1000;
+z = (z + 12) * 2 - (x - y) * 3;
+x = x - x / 1000 * 1000; y = y - y / 1000 * 1000; z = z - z / 1000 * 1000;
+z = (z + 12) * 2 - (x - y) * 3;
+x = x - x / 1000 * 1000; y = y - y / 1000 * 1000; z = z - z / 1000 * 1000;
+z = z - x * 8 + y * 5;
+x = x - x / 1000 * 1000; y = y - y / 1000 * 1000; z = z - z / 1000 * 1000;
+x = x - y * 9 + z / 16;
+x = x - x / 1000 * 1000; y = y - y / 1000 * 1000; z = z - z / 1000 * 1000;
+x = x * 3 + y;
+x = x - x / 1000 * 1000; y = y - y / 1000 * 1000; z = z - z / 1000 * 1000;
+y = y + x / 7;
+x = x - x / 1000 * 1000; y = y - y / 1000 * 1000; z = z - z / 1000 * 1000;
+z = z - x * 8 + y * 5;
+x = x - x / 1000 * 1000; y = y - y / 1000 * 1000; z = z - z / 1000 * 1000;
+x = x * 3 + y;
+x = x - x / 1000 * 1000; y = y - y / 1000 * 1000; z = z - z / 1000 * 1000;
+z = z - x * 8 + y * 5;
+x = x - x / 1000 * 1000; y = y - y / 1000 * 1000; z = z - z / 1000 * 1000;
+y = y * 10 - x / 4;
+x = x - x / 1000 * 1000; y = y - y / 1000 * 1000; z = z - z / 1000 * 1000;
+y = y + x / 7;
+x = x - x / 1000 * 1000; y = y - y / 1000 * 1000; z = z - z / 1000 * 1000;
+y = y * 10 - x / 4;
+x = x - x / 1000 * 1000; y = y - y / 1000 * 1000; z = z - z / 1000 * 1000;
+z = (z + 12) * 2 - (x - y) * 3;
+x = x - x / 1000 * 1000; y = y - y / 1000 * 1000; z = z - z / 1000 * 1000;
+z = (z + 12) * 2 - (x - y) * 3;
+x = x - x / 1000 * 1000; y = y - y / 1000 * 1000; z = z - z / 1000 * 1000;
+x = (x + z) / 9 - y;
+x = x - x / 1000 * 1000; y = y - y / 1000 * 1000; z = z - z / 1000 * 1000;
+z = (z + 12) * 2 - (x - y) * 3;
+x = x - x / 1000 * 1000; y = y - y / 1000 * 1000; z = z - z / 1000 * 1000;
+x = x * 3 + y;
+x = x - x / 1000 * 1000; y = y - y / 1000 * 1000; z = z - z / 1000 * 1000;
+y = y * 10 - x / 4;
+x = x - x / 1000 * 1000; y = y - y / 1000 * 1000; z = z - z / 1000 * 1000;
+x = x * 3 + y;
+x = x - x / 1000 * 1000; y = y - y / 1000 * 1000; z = z - z / 1000 * 1000;
+y = y * 10 - x / 4;
+x = x - x / 1000 * 1000; y = y - y / 1000 * 1000; z = z - z / 1000 * 1000;
+z = z - x * 8 + y * 5;
+x = x - x / 1000 * 1000; y = y - y / 1000 * 1000; z = z - z / 1000 * 1000;
+z = z - x * 8 + y * 5;
+x = x - x / 1000 * 1000; y = y - y / 1000 * 1000; z = z - z / 1000 * 1000;
+x = (x + z) / 9 - y;
+x = x - x / 1000 * 1000; y = y - y / 1000 * 1000; z = z - z / 1000 * 1000;
+y = y + x / 7;
+x = x - x / 1000 * 1000; y = y - y / 1000 * 1000; z = z - z / 1000 * 1000;
+y = y + x / 7;
+x = x - x / 1000 * 1000; y = y - y / 1000 * 1000; z = z - z / 1000 * 1000;
+x = x - y * 9 + z / 16;
+x = x - x / 1000 * 1000; y = y - y / 1000 * 1000; z = z - z / 1000 * 1000;
+x = x * 3 + y;
+x = x - x / 1000 * 1000; y = y - y / 1000 * 1000; z = z - z / 1000 * 1000;
+y = y * 10 - x / 4;
+x = x - x / 1000 * 1000; y = y - y / 1000 * 1000; z = z - z / 1000 * 1000;
+y = y * 10 - x / 4;
+x = x - x / 1000 * 1000; y = y - y / 1000 * 1000; z = z - z / 1000 * 1000;
+z = (z + 12) * 2 - (x - y) * 3;
+x = x - x / 1000 * 1000; y = y - y / 1000 * 1000; z = z - z / 1000 * 1000;
+x = x - y * 9 + z / 16;
+x = x - x / 1000 * 1000; y = y - y / 1000 * 1000; z = z - z / 1000 * 1000;
+y = y * 10 - x / 4;
+x = x - x / 1000 * 1000; y = y - y / 1000 * 1000; z = z - z / 1000 * 1000;
+return (x + y + z) - (x + y + z) / 256 * 256;
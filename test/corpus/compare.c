@@ -0,0 +1,35 @@
+a = 5;
+b = 12;
+c = 0 - 3;
+n = 0;
+n = n + (a < b) + (b <= 12) + (c == 0 - 3) + (a != b);
+a = a + (n < 50); b = b - (a == 6); c = c + (b != 12);
+a = a + (n < 50); b = b - (a == 6); c = c + (b != 12);
+a = a + (n < 50); b = b - (a == 6); c = c + (b != 12);
+n = n + (3 < a) * 2 + (a > c) - (b >= 100);
+n = n + (a * 2 < b + c) + (c * c <= a + b);
+a = a + (n < 50); b = b - (a == 6); c = c + (b != 12);
+n = n + (3 < a) * 2 + (a > c) - (b >= 100);
+a = a + (n < 50); b = b - (a == 6); c = c + (b != 12);
+a = a + (n < 50); b = b - (a == 6); c = c + (b != 12);
+n = n + (3 < a) * 2 + (a > c) - (b >= 100);
+n = n + (a * 2 < b + c) + (c * c <= a + b);
+n = n + (a < b) + (b <= 12) + (c == 0 - 3) + (a != b);
+a = a + (n < 50); b = b - (a == 6); c = c + (b != 12);
+n = n + (a < b) + (b <= 12) + (c == 0 - 3) + (a != b);
+n = n + (a * 2 < b + c) + (c * c <= a + b);
+a = a + (n < 50); b = b - (a == 6); c = c + (b != 12);
+a = a + (n < 50); b = b - (a == 6); c = c + (b != 12);
+n = n + (a * 2 < b + c) + (c * c <= a + b);
+n = n + (a * 2 < b + c) + (c * c <= a + b);
+n = n + (3 < a) * 2 + (a > c) - (b >= 100);
+a = a + (n < 50); b = b - (a == 6); c = c + (b != 12);
+a = a + (n < 50); b = b - (a == 6); c = c + (b != 12);
+n = n + (a * 2 < b + c) + (c * c <= a + b);
+n = n + (a < b) + (b <= 12) + (c == 0 - 3) + (a != b);
+a = a + (n < 50); b = b - (a == 6); c = c + (b != 12);
+n = n + (a * 2 < b + c) + (c * c <= a + b);
+n = n + (a * 2 < b + c) + (c * c <= a + b);
+n = n + (a < b) + (b <= 12) + (c == 0 - 3) + (a != b);
+n = n + (a < b) + (b <= 12) + (c == 0 - 3) + (a != b);
+n;
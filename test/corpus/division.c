@@ -0,0 +1,34 @@
+n = 1000003;
+d = 7;
+s = 0;
+s = s + n / 3 - n / 10 + n / 1024;
+n = n / 2 + n / 5 + 17;
+s = s + n / 3 - n / 10 + n / 1024;
+s = s - s / 100 * 100 + n / (d + 2);
+d = d + 1; s = s + n / -9;
+n = n / 2 + n / 5 + 17;
+s = s - s / 100 * 100 + n / (d + 2);
+s = s + (0 - n) / 7 + n / d;
+s = s + (0 - n) / 7 + n / d;
+d = d + 1; s = s + n / -9;
+s = s + (0 - n) / 7 + n / d;
+s = s + n / 3 - n / 10 + n / 1024;
+n = n / 2 + n / 5 + 17;
+s = s + n / 3 - n / 10 + n / 1024;
+d = d + 1; s = s + n / -9;
+s = s - s / 100 * 100 + n / (d + 2);
+n = n / 2 + n / 5 + 17;
+n = n / 2 + n / 5 + 17;
+n = n / 2 + n / 5 + 17;
+s = s + n / 3 - n / 10 + n / 1024;
+n = n / 2 + n / 5 + 17;
+n = n / 2 + n / 5 + 17;
+n = n / 2 + n / 5 + 17;
+n = n / 2 + n / 5 + 17;
+s = s + n / 3 - n / 10 + n / 1024;
+n = n / 2 + n / 5 + 17;
+n = n / 2 + n / 5 + 17;
+n = n / 2 + n / 5 + 17;
+n = n / 2 + n / 5 + 17;
+s = s - s / 100 * 100 + n / (d + 2);
+s = s - s / 256 * 256; s * (s > 0) - s * (s < 0);
@@ -0,0 +1,81 @@
+v0 = 1;
+v1 = 2;
+v2 = v1 * 2 - v0 + 2;
+v3 = v2 * 2 - v1 + 3;
+v4 = v3 * 2 - v2 + 4;
+v5 = v4 * 2 - v3 + 0;
+v6 = v5 * 2 - v4 + 1;
+v7 = v6 * 2 - v5 + 2;
+v8 = v7 * 2 - v6 + 3;
+v9 = v8 * 2 - v7 + 4;
+v10 = v9 * 2 - v8 + 0;
+v11 = v10 * 2 - v9 + 1;
+v12 = v11 * 2 - v10 + 2;
+v13 = v12 * 2 - v11 + 3;
+v14 = v13 * 2 - v12 + 4;
+v15 = v14 * 2 - v13 + 0;
+v16 = v15 * 2 - v14 + 1;
+v17 = v16 * 2 - v15 + 2;
+v18 = v17 * 2 - v16 + 3;
+v19 = v18 * 2 - v17 + 4;
+v20 = v19 * 2 - v18 + 0;
+v21 = v20 * 2 - v19 + 1;
+v22 = v21 * 2 - v20 + 2;
+v23 = v22 * 2 - v21 + 3;
+v24 = v23 * 2 - v22 + 4;
+v25 = v24 * 2 - v23 + 0;
+v26 = v25 * 2 - v24 + 1;
+v27 = v26 * 2 - v25 + 2;
+v28 = v27 * 2 - v26 + 3;
+v29 = v28 * 2 - v27 + 4;
+v30 = v29 * 2 - v28 + 0;
+v31 = v30 * 2 - v29 + 1;
+v32 = v31 * 2 - v30 + 2;
+v33 = v32 * 2 - v31 + 3;
+v34 = v33 * 2 - v32 + 4;
+v35 = v34 * 2 - v33 + 0;
+v36 = v35 * 2 - v34 + 1;
+v37 = v36 * 2 - v35 + 2;
+v38 = v37 * 2 - v36 + 3;
+v39 = v38 * 2 - v37 + 4;
+v40 = v39 * 2 - v38 + 0;
+v41 = v40 * 2 - v39 + 1;
+v42 = v41 * 2 - v40 + 2;
+v43 = v42 * 2 - v41 + 3;
+v44 = v43 * 2 - v42 + 4;
+v45 = v44 * 2 - v43 + 0;
+v46 = v45 * 2 - v44 + 1;
+v47 = v46 * 2 - v45 + 2;
+v48 = v47 * 2 - v46 + 3;
+v49 = v48 * 2 - v47 + 4;
+v50 = v49 * 2 - v48 + 0;
+v51 = v50 * 2 - v49 + 1;
+v52 = v51 * 2 - v50 + 2;
+v53 = v52 * 2 - v51 + 3;
+v54 = v53 * 2 - v52 + 4;
+v55 = v54 * 2 - v53 + 0;
+v56 = v55 * 2 - v54 + 1;
+v57 = v56 * 2 - v55 + 2;
+v58 = v57 * 2 - v56 + 3;
+v59 = v58 * 2 - v57 + 4;
+v60 = v59 * 2 - v58 + 0;
+v61 = v60 * 2 - v59 + 1;
+v62 = v61 * 2 - v60 + 2;
+v63 = v62 * 2 - v61 + 3;
+v64 = v63 * 2 - v62 + 4;
+v65 = v64 * 2 - v63 + 0;
+v66 = v65 * 2 - v64 + 1;
+v67 = v66 * 2 - v65 + 2;
+v68 = v67 * 2 - v66 + 3;
+v69 = v68 * 2 - v67 + 4;
+v70 = v69 * 2 - v68 + 0;
+v71 = v70 * 2 - v69 + 1;
+v72 = v71 * 2 - v70 + 2;
+v73 = v72 * 2 - v71 + 3;
+v74 = v73 * 2 - v72 + 4;
+v75 = v74 * 2 - v73 + 0;
+v76 = v75 * 2 - v74 + 1;
+v77 = v76 * 2 - v75 + 2;
+v78 = v77 * 2 - v76 + 3;
+v79 = v78 * 2 - v77 + 4;
+v79 - v78;
@@ -0,0 +1,11 @@
+a = 3;
+b = 5;
+c = 7;
+d = 11;
+r0 = (((((c + d) + (4 + a)) + ((b + 1) - (b - b))) - (((a * b) * (a + a)) + ((a + 8) + (d - c)))) + ((((a + 3) - (c + 3)) - ((b + b) - (b * d))) + (((a - 2) - (d - 2)) + ((b - b) + (d + d)))));
+r1 = (((((b + c) + (b * a)) + ((b * a) - (c + d))) * (((d * b) - (c * d)) * ((b * c) - (c + c)))) * ((((c * d) + (b - c)) + ((7 + a) + (c + 1))) * (((b * 6) + (c + 2)) * ((a + b) - (c - 7)))));
+r2 = (((((9 - a) + (c * a)) + ((a + c) + (a + c))) + (((d - d) - (d - 4)) + ((a - 5) * (a + c)))) * ((((d + b) + (2 - b)) * ((a * b) - (3 - 7))) + (((d * c) + (a + b)) - ((b * c) * (a + 5)))));
+r3 = (((((4 * c) * (d * d)) * ((8 - b) + (4 - 5))) + (((4 * c) - (a * c)) - ((b * a) * (c * b)))) * ((((b - a) - (c + b)) - ((b - 3) * (a - a))) - (((b * 2) * (d * c)) * ((b + 1) + (a + 9)))));
+r4 = (((((c - b) - (a * 6)) * ((b * d) * (a * 6))) + (((d + d) - (c * d)) - ((c + b) - (a - c)))) - ((((d + a) + (b - d)) * ((c * c) - (a * b))) + (((d - a) - (a - 9)) * ((b + b) * (a + a)))));
+r5 = (((((c + b) - (b + b)) * ((d + b) - (a - c))) - (((5 + d) * (b * b)) + ((c + b) + (8 - a)))) - ((((a * 1) - (d * 3)) + ((c - c) + (a * b))) * (((9 - b) - (a * 2)) * ((a - d) - (c - 9)))));
+(r0 + r1 + r2 + r3 + r4 + r5) - (r0 + r1 + r2 + r3 + r4 + r5) / 256 * 256;
@@ -1,52 +1,470 @@
 #! /usr/bin/env python
 
 from pathlib import Path
+import json
+import shutil
+import socket
+import struct
 import subprocess
+import sys
+import tempfile
+import time
 
 
 test_dir = Path(__file__).resolve().parent
 root_dir = test_dir.parent
 build_dir = root_dir / "build"
 exe = build_dir / "hokacc"
+runtime_exe = build_dir / "hokacc_runtime"
+const_eval_test_exe = build_dir / "hokacc_const_eval_test"
+corpus_dir = test_dir / "corpus"
+runtime_baseline = test_dir / "runtime_baseline.json"
+# アセンブリや実行ファイルなどの作業用のファイルはカレントディレクトリを汚さないように一時ディレクトリに置く
+scratch_dir = Path(tempfile.mkdtemp(prefix="hokacc_test."))
 
 
-def test(input: str, expected: int) -> bool:
-    result = subprocess.run([str(exe), input], stdout=subprocess.PIPE)
+def scratch(name: str) -> str:
+    return str(scratch_dir / name)
+
+
+def test(input: str, expected: int, flags: list = []) -> bool:
+    result = subprocess.run([str(exe), *flags, input], stdout=subprocess.PIPE)
     stdout = result.stdout.decode("utf-8")
-    with open("tmp.s", "w") as f:
+    with open(scratch("tmp.s"), "w") as f:
         f.write(stdout)
-    result = subprocess.run(["cc", "-o", "tmp", "tmp.s"])
-    result = subprocess.run(["./tmp"])
+    result = subprocess.run(["cc", "-o", scratch("tmp"), scratch("tmp.s")])
+    result = subprocess.run([scratch("tmp")])
     actual = result.returncode
 
-    print(f"input: {input}, expected: {expected}, actual: {actual}")
+    print(f"flags: {flags}, input: {input}, expected: {expected}, actual: {actual}")
+    return actual == expected
+
+
+# プロローグで確保するフレームの大きさを確かめる (sub rspがなければ0)
+def test_frame_size(input: str, expected: int, flags: list = []) -> bool:
+    result = subprocess.run([str(exe), *flags, input], stdout=subprocess.PIPE)
+    actual = 0
+    for line in result.stdout.decode("utf-8").splitlines():
+        if line.startswith("\tsub rsp, "):
+            actual = int(line.split(", ")[1])
+            break
+    print(f"flags: {flags}, frame size of input: {input}, expected: {expected}, actual: {actual}")
     return actual == expected
 
 
+# 出力のうち、ニーモニックがmnemonicの命令の数を確かめる
+def test_instr_count(input: str, mnemonic: str, expected: int, flags: list = []) -> bool:
+    result = subprocess.run([str(exe), *flags, input], stdout=subprocess.PIPE)
+    actual = sum(1 for line in result.stdout.decode("utf-8").splitlines() if line.split(" ")[0] == "\t" + mnemonic)
+    print(f"flags: {flags}, {mnemonic} in input: {input}, expected: {expected}, actual: {actual}")
+    return actual == expected
+
+
+# --jitはコンパイルしたコードをその場で実行し、結果を表示する
+def test_jit(input: str, expected: int, flags: list = []) -> bool:
+    result = subprocess.run([str(exe), *flags, "--jit", input], stdout=subprocess.PIPE)
+    actual = int(result.stdout.decode("utf-8"))
+
+    print(f"flags: {flags}, --jit input: {input}, expected: {expected}, actual: {actual}")
+    return actual == expected and result.returncode == expected & 0xff
+
+
+# --evalはコードを生成せずに評価する。コンパイル時の評価 (const_eval.hpp) と同じ評価器を使う
+def test_eval(input: str, expected: int) -> bool:
+    result = subprocess.run([str(exe), "--eval", input], stdout=subprocess.PIPE)
+    actual = int(result.stdout.decode("utf-8"))
+
+    print(f"--eval input: {input}, expected: {expected}, actual: {actual}")
+    return actual == expected and result.returncode == expected & 0xff
+
+
+# 実行時に例外になるプログラムは、--evalでは位置を示したエラーになる
+def test_eval_error(input: str, message: str) -> bool:
+    result = subprocess.run([str(exe), "--eval", input], stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+    ok = result.returncode == 1 and not result.stdout and message in result.stderr.decode("utf-8")
+
+    print(f"--eval input: {input}, expected error: {message}: {'ok' if ok else 'failed'}")
+    return ok
+
+
+def test_output_file(input: str) -> bool:
+    stdout = subprocess.run([str(exe), input], stdout=subprocess.PIPE).stdout
+    subprocess.run([str(exe), "-o", scratch("tmp.s"), input])
+    with open(scratch("tmp.s"), "rb") as f:
+        written = f.read()
+
+    print(f"input: {input}, -o output matches stdout: {written == stdout}")
+    return written == stdout
+
+
+# -jで全てのケースをファイルにして一括コンパイルする。壊れたファイルが混ざっていても他は出力される
+def test_batch(cases: list, flags: list = []) -> bool:
+    input_dir = scratch_dir / "batch"
+    output_dir = input_dir / "out"
+    shutil.rmtree(input_dir, ignore_errors=True)
+    input_dir.mkdir()
+    inputs = []
+    for i, (input, _) in enumerate(cases):
+        path = input_dir / f"case{i}.c"
+        path.write_text(input)
+        inputs.append(str(path))
+    (input_dir / "broken.c").write_text("a = 1;\nb = 2 $ 3;\n")
+    inputs.append(str(input_dir / "broken.c"))
+
+    result = subprocess.run([str(exe), *flags, "-j", "4", "-o", str(output_dir), *inputs], stderr=subprocess.PIPE)
+    ok = result.returncode == 1 and not (output_dir / "broken.s").exists()
+    for i, (input, expected) in enumerate(cases):
+        subprocess.run(["cc", "-o", scratch("tmp"), str(output_dir / f"case{i}.s")])
+        actual = subprocess.run([scratch("tmp")]).returncode
+        ok = ok and actual == expected
+    shutil.rmtree(input_dir)
+
+    print(f"flags: {flags}, -j 4 with {len(cases)} files and a broken one: {'ok' if ok else 'failed'}")
+    return ok
+
+
+def frame(body: bytes) -> bytes:
+    return struct.pack("<I", len(body)) + body
+
+
+def read_frame(read) -> bytes:
+    size, = struct.unpack("<I", read(4))
+    return read(size)
+
+
+# コンパイルサーバの応答が、同じ引数でコマンドラインから実行したときの出力と一致すること。
+# 壊れたプログラムにはエラーの応答を返し、その後の要求も続けて処理する
+def test_server(cases: list, flags: list, use_socket: bool) -> bool:
+    requests = [(request_flags, input) for input, _ in cases for request_flags in flags]
+    requests.append(([], "a = 1;\nb = 2 $ 3;"))
+    # 1文ずつ書き換えたプログラムを続けて送る。書き換えていない文はサーバが覚えた出力を使う
+    program = [input for input, _ in cases]
+    for i in range(0, len(program), 5):
+        edited = program.copy()
+        edited[i] = "zz = 9;"
+        requests.append(([], "\n".join(edited)))
+
+    def body(request_flags, input):
+        return " ".join(request_flags).encode() + b"\n" + input.encode()
+
+    if use_socket:
+        path = scratch_dir / "server.sock"
+        server = subprocess.Popen([str(exe), f"--server={path}", "-j", "2"], stderr=subprocess.DEVNULL)
+        while not path.exists():
+            time.sleep(0.01)
+        # ワーカーの数だけ何も送らない接続を張っておいても、他の接続の要求は処理される
+        idle = [socket.socket(socket.AF_UNIX, socket.SOCK_STREAM) for _ in range(2)]
+        for connection in idle:
+            connection.connect(str(path))
+        client = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        client.connect(str(path))
+        stream = client.makefile("rwb")
+        responses = []
+        for request_flags, input in requests:
+            stream.write(frame(body(request_flags, input)))
+            stream.flush()
+            responses.append(read_frame(stream.read))
+        client.close()
+        for connection in idle:
+            connection.close()
+        server.terminate()
+        server.wait()
+        path.unlink()
+    else:
+        stdin = b"".join(frame(body(request_flags, input)) for request_flags, input in requests)
+        result = subprocess.run([str(exe), "--server"], input=stdin, stdout=subprocess.PIPE)
+        rest = result.stdout
+        responses = []
+        while rest:
+            size, = struct.unpack("<I", rest[:4])
+            responses.append(rest[4:4 + size])
+            rest = rest[4 + size:]
+
+    ok = len(responses) == len(requests)
+    for (request_flags, input), response in zip(requests, responses):
+        expected = subprocess.run([str(exe), *request_flags, input], stdout=subprocess.PIPE, stderr=subprocess.DEVNULL)
+        status = 0 if expected.returncode == 0 else 1
+        ok = ok and response[0] == status and (status == 1 or response[1:] == expected.stdout)
+
+    print(f"server over {'socket' if use_socket else 'stdin'}: {len(requests)} requests: {'ok' if ok else 'failed'}")
+    return ok
+
+
+# キャッシュを通した出力がキャッシュなしの出力と一致し、2回目はヒットすること
+def test_cache(cases: list, flags: list) -> bool:
+    cache_dir = scratch_dir / "cache"
+    shutil.rmtree(cache_dir, ignore_errors=True)
+    ok = True
+    for input, _ in cases:
+        expected = subprocess.run([str(exe), *flags, input], stdout=subprocess.PIPE).stdout
+        for hits in [0, 1]:
+            result = subprocess.run([str(exe), *flags, f"--cache-dir={cache_dir}", "--cache-stats", input],
+                                    stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+            ok = ok and result.stdout == expected and f"cache: {hits} hits".encode() in result.stderr
+    shutil.rmtree(cache_dir)
+
+    print(f"flags: {flags}, cache with {len(cases)} programs: {'ok' if ok else 'failed'}")
+    return ok
+
+
+# --stats=jsonの出力が読めて、フェーズと入力の規模が記録されていること。出力は--statsなしと同じになる
+def test_stats(input: str, phases: list, flags: list = []) -> bool:
+    expected = subprocess.run([str(exe), *flags, input], stdout=subprocess.PIPE).stdout
+    result = subprocess.run([str(exe), *flags, "--stats=json", input], stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+    stats = json.loads(result.stderr.decode("utf-8").splitlines()[-1])
+    names = [phase["name"] for phase in stats["phases"]]
+    ok = (result.stdout == expected and names == phases and stats["input_bytes"] == len(input.encode())
+          and stats["tokens"] > 0 and stats["nodes"] > 0 and stats["variables"] > 0 and stats["instrs"] > 0
+          and stats["total"]["allocations"] > 0 and stats["total"]["peak_rss_kib"] > 0)
+
+    print(f"flags: {flags}, --stats=json phases: {names}: {'ok' if ok else 'failed'}")
+    return ok
+
+
+# 深い入れ子でもスタックが溢れないこと。入力が長いので表示は省く
+def test_deep_nesting(depth: int, flags: list = [], mode: str = "--jit") -> bool:
+    input = "a = " + "1 - (" * depth + "3" + ")" * depth + "; a * 2;"
+    expected = (1 - 3 if depth % 2 else 3) * 2
+    result = subprocess.run([str(exe), *flags, mode, input], stdout=subprocess.PIPE)
+    actual = int(result.stdout.decode("utf-8"))
+
+    print(f"flags: {flags}, {mode} {depth} nested parentheses, expected: {expected}, actual: {actual}")
+    return actual == expected
+
+
+# --evalは深い入れ子にも上限を設けない
+def test_eval_deep_negation(depth: int) -> bool:
+    input = "-(" * depth + "1" + ")" * depth + ";"
+    expected = -1 if depth % 2 else 1
+    result = subprocess.run([str(exe), "--eval", input], stdout=subprocess.PIPE)
+    actual = int(result.stdout.decode("utf-8"))
+
+    print(f"--eval {depth} nested negations, expected: {expected}, actual: {actual}")
+    return actual == expected
+
+
+# 定数評価器のテスト。static_assertの分はビルドできた時点で通っている
+def test_const_eval() -> bool:
+    result = subprocess.run([str(const_eval_test_exe)], stdout=subprocess.PIPE)
+    print(result.stdout.decode("utf-8"), end="")
+    return result.returncode == 0
+
+
+def text_section(obj: str) -> bytes:
+    subprocess.run(["objcopy", "-O", "binary", "--only-section=.text", obj, scratch("tmp.bin")])
+    with open(scratch("tmp.bin"), "rb") as f:
+        return f.read()
+
+
+# --emit=objの出力をリンクして実行し、さらに機械語がアセンブラの出力と一致するか確かめる
+def test_emit_obj(input: str, expected: int, flags: list = []) -> bool:
+    subprocess.run([str(exe), *flags, "--emit=obj", "-o", scratch("tmp.o"), input])
+    subprocess.run(["cc", "-o", scratch("tmp"), scratch("tmp.o")])
+    actual = subprocess.run([scratch("tmp")]).returncode
+
+    subprocess.run([str(exe), *flags, "-o", scratch("tmp.s"), input])
+    subprocess.run(["cc", "-c", "-o", scratch("tmp_as.o"), scratch("tmp.s")])
+    same_text = text_section(scratch("tmp.o")) == text_section(scratch("tmp_as.o"))
+
+    print(f"flags: {flags}, --emit=obj input: {input}, expected: {expected}, actual: {actual}, "
+          f"matches assembler: {same_text}")
+    return actual == expected and same_text
+
+
+# 生成したコードの質を測る。コーパスのプログラムをそれぞれのフラグで実行し、結果をbuild/runtime_results.jsonに書く。
+# 実行しなくても決まる命令数・最初のretまでの命令数・機械語のバイト数がベースラインより増えたら失敗にする。
+# perfのカウンタが使えればリタイアした命令数も比べ、時間とサイクル数は記録して表示するだけにする。
+# update_baselineなら (または、ベースラインがまだなければ) 今回の結果をベースラインにする
+def test_runtime(flag_sets: list, update_baseline: bool) -> bool:
+    programs = [str(p) for p in sorted(corpus_dir.glob("*.c"))]
+    results = {}
+    for flags in flag_sets:
+        result = subprocess.run([str(runtime_exe), *flags, "--runs=2000", *programs],
+                                stdout=subprocess.PIPE, stderr=subprocess.DEVNULL)
+        if result.returncode != 0:
+            print(f"flags: {flags}, hokacc_runtime failed")
+            return False
+        for r in json.loads(result.stdout):
+            results[f"{Path(r['program']).name} {' '.join(flags) or '-O1'}"] = r
+    with open(build_dir / "runtime_results.json", "w") as f:
+        json.dump(results, f, indent=2)
+
+    if update_baseline or not runtime_baseline.exists():
+        keys = ["statements", "instrs", "executed", "bytes", "instrs_per_statement", "bytes_per_statement", "instructions"]
+        with open(runtime_baseline, "w") as f:
+            json.dump({name: {k: r[k] for k in keys} for name, r in results.items()}, f, indent=2)
+            f.write("\n")
+        print(f"runtime baseline written to {runtime_baseline}")
+        return True
+
+    with open(runtime_baseline) as f:
+        baseline = json.load(f)
+    ok = True
+    for name, r in results.items():
+        base = baseline.get(name)
+        print(f"runtime {name}: {r['instrs']} instrs, {r['executed']} executed, {r['bytes']} bytes, "
+              f"{r['instrs_per_statement']} instrs/stmt, {r['ns']} ns, {r['cycles']} cycles")
+        if base is None:
+            print(f"runtime {name}: not in the baseline")
+            continue
+        for key in ["instrs", "executed", "bytes"]:
+            if r[key] > base[key]:
+                print(f"runtime {name}: {key} regressed from {base[key]} to {r[key]}")
+                ok = False
+        if r["instructions"] is not None and base["instructions"] is not None \
+                and r["instructions"] > base["instructions"] * 1.02:
+            print(f"runtime {name}: retired instructions regressed from {base['instructions']} to {r['instructions']}")
+            ok = False
+    return ok
+
+
+cases = [
+    ("1;", 1),
+    ("0;", 0),
+    ("42;", 42),
+    ("42+3;", 45),
+    ("13+192-2;", 203),
+    (" 13 + 192 - 2  ;", 203),
+    ("(1 + 2) * 4 / (20 - 18);", 6),
+    ("+12;", 12),
+    ("- ((1 + 2) * 4 / (20 - 18)) + 10;", 4),
+    ("+ ((1 + 2) * 4 / (20 - 18)) + 10;", 16),
+    ("12 == 8 + 4;", 1),
+    ("12 < 8 + 4;", 0),
+    ("3 * 4 > 8 + 4;", 0),
+    ("3 * 4 >= 8 + 4;", 1),
+    ("3 + 4 <= 8 + 4 != 0;", 1),
+    ("a = 1;", 1),
+    ("a = 102; b = 2; a;", 102),
+    ("aiko = 1; becky = 2; aiko + becky == 3;", 1),
+    ("S_var = 25; t__123=22; S_var + t__123;", 47),
+    ("return 12;", 12),
+    ("S_var = 25; t__123=22; return S_var + t__123; 12;", 47),
+    ("long_identifier_over_sixteen_chars = 7;\n\t\t                  long_identifier_over_sixteen_chars * 2;", 14),
+    ("returned = 3; return returned;", 3),
+    ("a = 5; a - a + (a == a) * 3;", 3),
+    ("x = 7; 0 - x + 10;", 3),
+    ("a = 4; a * 1 + 0;", 4),
+    ("b = 3; (b = 5) * 0 + b;", 5),
+    ("c = 2; c / 1 * -1 + 10;", 8),
+    ("100000 * 100000 / 1000000000;", 10),
+    ("a = 100000 * 100000; a / 1000000000;", 10),
+    ("a = 1; b = 2; c = 3; d = 4; (a + b) * (c + d) - (a * b + c * d) / (d - c);", 7),
+    ("a = 2; (a = 5) + a * 2;", 15),
+    ("a=1;b=2;c=3;d=4;e=5;f=6;g=7;h=8; a+(b+(c+(d+(e+(f+(g+(h+(a*b))))))));", 38),
+    ("a=1; a+(a=2)+(a=3)+(a=4)+(a=5)+(a=6)+(a=7)+(a=8)+(a=9)-(a+(b=a+(c=a+(d=a+(e=a+(f=a+(g=a+(h=a+1))))))))+100;", 72),
+    ("x = 100; y = 7; x / y * y + x - x / y * y - 100 + (x < y) + (y <= x) * 2 + (x != y);", 3),
+    ("x = 37; x * 8 + x * 3 - x * 5 - x * 9 + x * -4 + 300;", 41),
+    ("x = 100; x / 7 + x / -4 + x / 8;", 1),
+    ("x = 0 - 100; x / 7 + x / -4 + x / 8 + 50;", 49),
+    ("x = 0 - 1000; x / 3 / -5 + x / 1000000 * 3;", 66),
+    ("x = 5; (3 < x) + (5 <= x) * 2 + (x < 3) * 4 + (6 <= x) * 8 + (x == 5) * 16 + (5 != x) * 32;", 19),
+    ("x = 7; y = x * 6 - 2; 100 - y + y / 10 * 10 + x * 1 - x * 0;", 107),
+    ("x = 0 - 9; (x * -3 + x / 2 * 5) / -1 + 30;", 23),
+    ("x = 100000 * 100000; x / 99999 - 100000;", 1),
+    (" ".join(f"v{i} = {i % 7};" for i in range(30)) + " " + " + ".join(f"v{i}" for i in range(30)) + ";", 85),
+    ("a = 1; b = a + 1; c = b + 1; d = c + 1; a = 9; c = 10; d * 2 + (b = 7) * 0;", 8),
+    ("a = 2; b = a * 3; a = b + 1; c = a * a; b = c - a; b;", 42),
+    ("a = 7; b = 11; a * b + a * b;", 154),
+    ("a = 7; b = 11; c = a * b; a = 13; c + a * b;", 220),
+    ("x = 6; y = 7; (x < y) + (x < y) * 2 + (y * x == x * y) * 4 + (y * x - 40) * 8;", 23),
+    ("a = 9; b = a / (a - 6) + a / (a - 6); b;", 6),
+    ("a = 5; b = a * a; a = (b = a * a + 1) + a * a; a + b;", 77),
+]
+
+# 三番地コードのバックエンドで、同じ値を求める命令が1つにまとまること (入力, ニーモニック, 数)
+cse_cases = [
+    ("a = 7; b = 11; a * b + a * b;", "imul", 1),
+    ("a = 7; b = 11; c = a * b; a = 13; c + a * b;", "imul", 2),
+    ("x = 6; y = 7; (x < y) + (x < y) * 2 + (y * x == x * y) * 4 + (y * x - 40) * 8;", "imul", 1),
+    ("x = 6; y = 7; (x < y) + (x < y) * 2 + (y * x == x * y) * 4 + (y * x - 40) * 8;", "cmp", 2),
+    ("a = 9; b = a / (a - 6) + a / (a - 6); b;", "idiv", 1),
+]
+
+# 最適化するとスロットを共有し、読まれない変数には置き場所を作らない
+frame_cases = [
+    ("a = 3; a * 2;", 16, 16),
+    ("a = 1; b = a + 1; c = b + 1; d = c + 1; d;", 16, 32),
+    ("a = 1; b = 2; c = 3; a + b + c;", 32, 32),
+    ("x = 5; y = 6; 1;", 0, 16),
+    ("1 + 2;", 0, 0),
+    (" ".join(f"v{i} = {i};" for i in range(30)) + " v29;", 16, 240),
+]
+
+# 全てのケースをそれぞれのフラグで試す
+flag_sets = [
+    [],
+    ["-O0"],
+    ["--backend=reg"],
+    ["-O0", "--backend=reg"],
+    ["--peephole=none"],
+    ["-O0", "--peephole=all", "--peephole-window=8"],
+    ["--peephole=push-pop-same,lvar-addr"],
+    ["--backend=reg", "--peephole=push-pop-around", "--peephole-window=2"],
+    ["--backend=ir"],
+    ["-O0", "--backend=ir"],
+]
+
+runtime_flag_sets = [
+    ["-O0"],
+    [],
+    ["--backend=reg"],
+    ["--backend=ir"],
+]
+
+obj_flag_sets = [
+    [],
+    ["-O0"],
+    ["--backend=reg"],
+    ["--backend=ir"],
+]
+
+
 def main():
-    assert(test("1;", 1))
-    assert(test("0;", 0))
-    assert(test("42;", 42))
-    assert(test("42+3;", 45))
-    assert(test("13+192-2;", 203))
-    assert(test(" 13 + 192 - 2  ;", 203))
-    assert(test("(1 + 2) * 4 / (20 - 18);", 6))
-    assert(test("+12;", 12))
-    assert(test("- ((1 + 2) * 4 / (20 - 18)) + 10;", 4))
-    assert(test("+ ((1 + 2) * 4 / (20 - 18)) + 10;", 16))
-    assert(test("12 == 8 + 4;", 1))
-    assert(test("12 < 8 + 4;", 0))
-    assert(test("3 * 4 > 8 + 4;", 0))
-    assert(test("3 * 4 >= 8 + 4;", 1))
-    assert(test("3 + 4 <= 8 + 4 != 0;", 1))
-    assert(test("a = 1;", 1))
-    assert(test("a = 102; b = 2; a;", 102))
-    assert(test("aiko = 1; becky = 2; aiko + becky == 3;", 1))
-    assert(test("S_var = 25; t__123=22; S_var + t__123;", 47))
-    assert(test("return 12;", 12))
-    assert(test("S_var = 25; t__123=22; return S_var + t__123; 12;", 47))
+    for flags in flag_sets:
+        for input, expected in cases:
+            assert(test(input, expected, flags))
+    for flags in obj_flag_sets:
+        for input, expected in cases:
+            assert(test_emit_obj(input, expected, flags))
+    for flags in flag_sets:
+        for input, expected in cases:
+            assert(test_jit(input, expected, flags))
+    for input, expected in cases:
+        assert(test_eval(input, expected))
+    assert(test_eval_error("a = 3; a / (a - 3);", "Division by zero"))
+    assert(test_eval_error("a = 1; a + b;", "Uninitialized variable"))
+    assert(test_eval_error("a = 1; (a + 1 = 2);", "Expected LVar"))
+    assert(test_const_eval())
+    for flags in flag_sets:
+        assert(test_deep_nesting(20001, flags))
+    assert(test_deep_nesting(20001, [], "--eval"))
+    assert(test_eval_deep_negation(40001))
+    for input, optimized, unoptimized in frame_cases:
+        for backend in [[], ["--backend=reg"]]:
+            assert(test_frame_size(input, optimized, backend))
+            assert(test_frame_size(input, unoptimized, ["-O0", *backend]))
+    for input, mnemonic, expected in cse_cases:
+        assert(test_instr_count(input, mnemonic, expected, ["--backend=ir"]))
+    assert(test_output_file("a = 3; b = a * 2; return a + b;"))
+    stats_input = "a = 3; b = a * 2; return a + b;"
+    assert(test_stats(stats_input, ["lex", "parse", "fold", "codegen", "peephole", "emit"]))
+    assert(test_stats(stats_input, ["lex", "parse", "codegen", "emit"], ["-O0", "--backend=reg"]))
+    assert(test_stats(stats_input, ["lex", "parse", "fold", "lower", "pass unreachable", "pass forward-stores",
+                                    "pass cse", "pass dce", "codegen", "peephole", "emit"], ["--backend=ir", "--emit=obj"]))
+    assert(test_batch(cases))
+    assert(test_batch(cases, ["--backend=ir"]))
+    assert(test_cache(cases, []))
+    assert(test_cache(cases, ["--backend=ir", "--emit=obj"]))
+    server_flags = [[], ["--backend=reg", "-O0"], ["--backend=ir"], ["--emit=obj"]]
+    assert(test_server(cases, server_flags, False))
+    assert(test_server(cases, server_flags, True))
+    assert(test_runtime(runtime_flag_sets, "--update-baseline" in sys.argv))
     print("******** All tests passed! ********")
 
 
 if __name__ == "__main__":
-    main()
+    try:
+        main()
+    finally:
+        shutil.rmtree(scratch_dir, ignore_errors=True)